@@ -0,0 +1,48 @@
+/**
+ * @file bench_util.hpp
+ * @author HUANG Qiyue
+ * @brief Matrix files for the benchmarks in bench/.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "../defs.h"
+#include "../structures.hpp"
+
+/**
+ * @brief Writes an N x N row-major uint32_t matrix file whose element
+ *        (i, j) is value(i, j), one write per row.
+ */
+template <class F>
+void make_matrix_file(const char* filename, uint32_t N, F value) {
+    std::fstream fs(filename, std::ios::out | std::ios::binary);
+    uint32_t header[MATRIX_METADATA] = {MAGIC, N, N, sizeof(uint32_t),
+                                        LAYOUT_ROW_MAJOR, MATRIX_ARR_OFFSET};
+    fs.write(reinterpret_cast<char*>(header), sizeof(header));
+    std::vector<uint32_t> line(N);
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = 0; j < N; ++j) line[j] = value(i, j);
+        fs.write(reinterpret_cast<char*>(line.data()),
+                 line.size() * sizeof(uint32_t));
+    }
+}
+
+/* N x N random elements, the same ones on every call */
+inline void make_matrix_file(const char* filename, uint32_t N) {
+    std::mt19937 rng(42);
+    make_matrix_file(filename, N, [&rng](size_t, size_t) { return rng(); });
+}
+
+#endif
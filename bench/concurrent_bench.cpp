@@ -0,0 +1,87 @@
+/**
+ * @file concurrent_bench.cpp
+ * @author HUANG Qiyue
+ * @brief Scaling of concurrent_buffer_t from 1 to N threads.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * Each thread multiplies its band of rows of c = a * b in ikj order through
+ * shared concurrent buffers. The files are memory-mapped so the numbers
+ * show the cost of the cache and its locks rather than of the disk.
+ *
+ * Build from the repository root:
+ *     g++ -std=c++17 -O2 -pthread bench/concurrent_bench.cpp \
+ *         -o concurrent_bench
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../concurrent_buffer.hpp"
+#include "../defs.h"
+#include "bench_util.hpp"
+
+const size_t N = 128;         // matrices are N x N
+const size_t LINE_SIZE = 16;  // elements per line
+const size_t CAPACITY = 256;  // lines, a quarter of a matrix
+const size_t SHARDS = 64;
+
+using bench_clock = std::chrono::steady_clock;
+
+/* seconds for one multiply on nthreads threads */
+static double bench_multiply(size_t nthreads, float& miss_rate) {
+    using buffer = concurrent_buffer_t<uint32_t>;
+    buffer a("a_bench.dat", CAPACITY, SHARDS, LINE_SIZE, WRITE_BACK,
+             STORAGE_MMAP);
+    buffer b("b_bench.dat", CAPACITY, SHARDS, LINE_SIZE, WRITE_BACK,
+             STORAGE_MMAP);
+    buffer c("c_bench.dat", CAPACITY, SHARDS, LINE_SIZE, WRITE_BACK,
+             STORAGE_MMAP);
+
+    auto t0 = bench_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nthreads; ++t) {
+        workers.emplace_back([&, t]() {
+            auto wa = a.worker(), wb = b.worker(), wc = c.worker();
+            for (size_t i = N * t / nthreads; i < N * (t + 1) / nthreads; ++i)
+                for (size_t k = 0; k < N; ++k)
+                    for (size_t j = 0; j < N; ++j)
+                        wc.assign(i, j, wc[i][j] + wa[i][k] * wb[k][j]);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    c.flush();
+    std::chrono::duration<double> sec = bench_clock::now() - t0;
+
+    miss_rate = 1.0f * (a.miss_count + b.miss_count + c.miss_count) /
+                (a.read_count + b.read_count + c.read_count);
+    return sec.count();
+}
+
+int main() {
+    make_matrix_file("a_bench.dat", N);
+    make_matrix_file("b_bench.dat", N);
+    make_matrix_file("c_bench.dat", N);
+
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double base = 0;
+    printf("%8s%10s%12s%9s%9s\n", "Threads", "Seconds", "Mreads/s",
+           "Speedup", "Miss");
+    for (size_t nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        float miss_rate;
+        double sec = bench_multiply(nthreads, miss_rate);
+        if (nthreads == 1) base = sec;
+        printf("%8zu%10.3f%12.2f%9.2f%9.3f\n", nthreads, sec,
+               3.0 * N * N * N / sec / 1e6, base / sec, miss_rate);
+    }
+
+    std::remove("a_bench.dat");
+    std::remove("b_bench.dat");
+    std::remove("c_bench.dat");
+    return 0;
+}
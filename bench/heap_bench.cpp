@@ -0,0 +1,98 @@
+/**
+ * @file heap_bench.cpp
+ * @author HUANG Qiyue
+ * @brief MinMaxHeap against interval_heap_t on the operations of the
+ *        ext_qsort middle group.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * For every heap size: "fill" pushes N random keys, "replace" runs the
+ * step of run formation for keys drawn between the current min and max
+ * (pop the min or the max, alternately, and push the key), and "drain"
+ * pops the mins of a full heap. interval_heap_t runs replace twice, with
+ * popMin()/popMax() and push() as MinMaxHeap does, and with the fused
+ * replaceMin()/replaceMax() that ext_qsort uses. Times are ns per key.
+ *
+ * Build from the repository root:
+ *     g++ -std=c++17 -O2 bench/heap_bench.cpp -o heap_bench
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../extern/MinMaxHeap.hpp"
+#include "../interval_heap.hpp"
+
+const size_t REPLACE_OPS = 1 << 22;
+
+using bench_clock = std::chrono::steady_clock;
+
+static double ns_per(size_t ops, bench_clock::time_point since) {
+    std::chrono::duration<double> sec = bench_clock::now() - since;
+    return sec.count() / ops * 1e9;
+}
+
+static uint64_t sink = 0;  // keeps the popped keys alive
+
+struct result_t {
+    double fill, replace, drain;
+};
+
+template <class Heap, bool fused>
+static result_t bench(size_t n) {
+    std::mt19937 rng(42);
+    Heap heap;
+    result_t r;
+
+    auto t0 = bench_clock::now();
+    for (size_t i = 0; i < n; ++i) heap.push(rng());
+    r.fill = ns_per(n, t0);
+
+    t0 = bench_clock::now();
+    for (size_t i = 0; i < REPLACE_OPS; ++i) {
+        uint32_t lo = heap.findMin(), hi = heap.findMax();
+        uint32_t x = lo + rng() % (uint64_t(hi - lo) + 1);
+        if (i & 1) {
+            if constexpr (fused)
+                sink += heap.replaceMin(x);
+            else
+                sink += heap.popMin(), heap.push(x);
+        } else {
+            if constexpr (fused)
+                sink += heap.replaceMax(x);
+            else
+                sink += heap.popMax(), heap.push(x);
+        }
+    }
+    r.replace = ns_per(REPLACE_OPS, t0);
+
+    t0 = bench_clock::now();
+    while (!heap.empty()) sink += heap.popMin();
+    r.drain = ns_per(n, t0);
+    return r;
+}
+
+int main() {
+    printf("%-10s%-26s%10s%10s%10s\n", "Keys", "Heap", "fill", "replace",
+           "drain");
+    for (size_t n : {1 << 10, 1 << 16, 1 << 20, 1 << 23}) {
+        struct {
+            const char* name;
+            result_t r;
+        } rows[] = {
+            {"MinMaxHeap", bench<MinMaxHeap<uint32_t>, false>(n)},
+            {"interval_heap_t", bench<interval_heap_t<uint32_t>, false>(n)},
+            {"interval_heap_t replace*",
+             bench<interval_heap_t<uint32_t>, true>(n)},
+        };
+        for (auto& row : rows)
+            printf("%-10zu%-26s%10.1f%10.1f%10.1f\n", n, row.name, row.r.fill,
+                   row.r.replace, row.r.drain);
+    }
+    return sink == 42;  // never, but the pops cannot be elided
+}
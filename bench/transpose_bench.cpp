@@ -0,0 +1,82 @@
+/**
+ * @file transpose_bench.cpp
+ * @author HUANG Qiyue
+ * @brief Throughput of transpose_file() for several memory budgets.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * Generates an N x N uint32_t matrix file and transposes it once per
+ * memory budget, then checks sampled elements of the copy through a
+ * buffer_t, which reads the transposed header. For a run beyond RAM pick N
+ * with 4 N^2 bytes above the physical memory printed first, so that the
+ * page cache cannot hold the file:
+ *     ./transpose_bench 131072 16777216 268435456     (64 GiB file)
+ *
+ * Build from the repository root:
+ *     g++ -std=c++17 -O2 bench/transpose_bench.cpp -o transpose_bench
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../defs.h"
+#include "../structures.hpp"
+#include "../transpose.hpp"
+#include "bench_util.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+/* element (i, j) of the generated matrix */
+static uint32_t value_of(size_t i, size_t j) {
+    return uint32_t(i * 2654435761u) ^ uint32_t(j);
+}
+
+/* samples random elements of the transposed copy */
+static bool check(const char* filename, uint32_t N, size_t samples) {
+    buffer_t<uint32_t> t(filename, 1, 1);
+    std::mt19937 rng(42);
+    for (size_t n = 0; n < samples; ++n) {
+        size_t i = rng() % N, j = rng() % N;
+        if (t.read(i, j) != value_of(i, j)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t N = argc > 1 ? strtoul(argv[1], nullptr, 0) : 8192;
+    std::vector<size_t> budgets;
+    for (int n = 2; n < argc; ++n)
+        budgets.push_back(strtoull(argv[n], nullptr, 0));
+    if (budgets.empty()) budgets = {4096, 1 << 20, 16 << 20, 256 << 20};
+
+    double ram = 1.0 * sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+    double bytes = 4.0 * N * N;
+    printf("N: %u, File: %.2f GiB, RAM: %.2f GiB\n", N, bytes / (1 << 30),
+           ram / (1 << 30));
+
+    make_matrix_file("t_bench.dat", N, value_of);
+    printf("%-12s%12s%10s%10s%14s%8s\n", "Memory", "Tile", "Seconds",
+           "MB/s", "I/O calls", "Check");
+    for (auto mem : budgets) {
+        transpose_stat_t stat;
+        auto t0 = bench_clock::now();
+        transpose_file("t_bench.dat", "tt_bench.dat", mem, stat);
+        std::chrono::duration<double> s = bench_clock::now() - t0;
+        auto tile = std::to_string(stat.tile) + "x" + std::to_string(stat.tile);
+        printf("%-12zu%12s%10.3f%10.1f%14" PRIu64 "%8s\n", mem, tile.c_str(),
+               s.count(), bytes / s.count() / 1e6,
+               stat.read_ops + stat.write_ops,
+               check("tt_bench.dat", N, 1000) ? "ok" : "FAIL");
+    }
+    std::remove("t_bench.dat");
+    std::remove("tt_bench.dat");
+    return 0;
+}
@@ -0,0 +1,801 @@
+/**
+ * @file cache_engines.hpp
+ * @author HUANG Qiyue
+ * @brief Replacement engines used by buffer_t.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * An engine only does the bookkeeping of a cache: it maps a resident key to
+ * a slot in [0, capacity) and decides which key to evict. The cached values
+ * themselves live in the slot array owned by buffer_t.
+ *
+ * Every engine provides
+ *     size_t find(size_t key, bool demand = true);  // slot or CACHE_NPOS
+ *     size_t insert(size_t key, size_t& victim);    // slot for a new key
+ *     size_t size() const;
+ *     size_t capacity() const;
+ *     void clear();
+ * find() counts as an access and refreshes the key; demand is false for
+ * lookups made on behalf of a pre-fetch. insert() must only be
+ * called for a non-resident key; victim receives the evicted key, or
+ * CACHE_NPOS if a free slot was used.
+ *
+ * Engines that need more than a capacity (opt_t) are handed to buffer_t
+ * already constructed.
+ *
+ * lru_list_t, flat_lru_t and clock_cache_t can also drop a key early:
+ *     bool erase(size_t key);  // false if key was not resident
+ * its slot is handed out again by the next insert(). They also list their
+ * keys for buffer_t snapshots:
+ *     std::vector<size_t> keys() const;
+ * inserting the keys in that order into an empty engine rebuilds it. The
+ * LRUs list from least to most recent, so the rebuild is exact; CLOCK
+ * lists from the hand on, and its reference bits come back all set.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef CACHE_ENGINES_H
+#define CACHE_ENGINES_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+constexpr size_t CACHE_NPOS = SIZE_MAX;
+
+/**
+ * @brief LRU with std::list as recency list and std::unordered_map as index.
+ *        One heap node per cache line.
+ */
+class lru_list_t {
+   public:
+    explicit lru_list_t(size_t capacity) : capacity_(capacity) {}
+
+    size_t find(size_t key, bool /* demand */ = true) {
+        auto it = map_.find(key);
+        if (it == map_.end()) return CACHE_NPOS;
+        list_.splice(list_.begin(), list_, it->second);
+        return it->second->slot;
+    }
+
+    size_t insert(size_t key, size_t& victim) {
+        size_t slot;
+        victim = CACHE_NPOS;
+        if (list_.size() == capacity_) {
+            victim = list_.back().key;
+            slot = list_.back().slot;
+            map_.erase(victim);
+            list_.pop_back();
+        } else if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+        } else {
+            slot = list_.size();
+        }
+        list_.push_front(node_t{key, slot});
+        map_[key] = list_.begin();
+        return slot;
+    }
+
+    bool erase(size_t key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) return false;
+        free_.push_back(it->second->slot);
+        list_.erase(it->second);
+        map_.erase(it);
+        return true;
+    }
+
+    std::vector<size_t> keys() const {
+        std::vector<size_t> ret;
+        for (auto it = list_.rbegin(); it != list_.rend(); ++it)
+            ret.push_back(it->key);
+        return ret;
+    }
+
+    size_t size() const { return list_.size(); }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        list_.clear();
+        map_.clear();
+        free_.clear();
+    }
+
+   private:
+    struct node_t {
+        size_t key;
+        size_t slot;
+    };
+
+    size_t capacity_;
+    std::list<node_t> list_;
+    std::unordered_map<size_t, typename std::list<node_t>::iterator> map_;
+    std::vector<size_t> free_;  // erased slots, reused first
+};
+
+/**
+ * @brief LRU over preallocated arrays: the recency list is linked through
+ *        slot indices and keys are indexed by an open-addressing table with
+ *        linear probing. Nothing is allocated after construction.
+ */
+class flat_lru_t {
+   public:
+    explicit flat_lru_t(size_t capacity)
+        : capacity_(capacity),
+          keys_(capacity),
+          prev_(capacity),
+          next_(capacity) {
+        size_t table_size = 16;
+        while (table_size < 2 * capacity_) table_size <<= 1;
+        table_.assign(table_size, EMPTY);
+        mask_ = table_size - 1;
+        free_.reserve(capacity);
+        clear();
+    }
+
+    size_t find(size_t key, bool /* demand */ = true) {
+        uint32_t slot = table_[probe(key)];
+        if (slot == EMPTY) return CACHE_NPOS;
+        move_to_front(slot);
+        return slot;
+    }
+
+    size_t insert(size_t key, size_t& victim) {
+        uint32_t slot;
+        victim = CACHE_NPOS;
+        if (size_ == capacity_) {
+            slot = tail_;
+            victim = keys_[slot];
+            erase_index(probe(victim));
+            unlink(slot);
+        } else if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+            size_++;
+        } else {
+            slot = size_++;
+        }
+        keys_[slot] = key;
+        table_[probe(key)] = slot;
+        link_front(slot);
+        return slot;
+    }
+
+    bool erase(size_t key) {
+        size_t pos = probe(key);
+        uint32_t slot = table_[pos];
+        if (slot == EMPTY) return false;
+        erase_index(pos);
+        unlink(slot);
+        free_.push_back(slot);
+        size_--;
+        return true;
+    }
+
+    std::vector<size_t> keys() const {
+        std::vector<size_t> ret;
+        for (uint32_t slot = tail_; slot != EMPTY; slot = prev_[slot])
+            ret.push_back(keys_[slot]);
+        return ret;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        std::fill(table_.begin(), table_.end(), EMPTY);
+        head_ = tail_ = EMPTY;
+        size_ = 0;
+        free_.clear();
+    }
+
+   private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    size_t hash(size_t key) const {
+        return (key * 0x9E3779B97F4A7C15ULL) >> 17 & mask_;
+    }
+
+    /* position holding key, or the empty position where it would go */
+    size_t probe(size_t key) const {
+        size_t pos = hash(key);
+        while (table_[pos] != EMPTY && keys_[table_[pos]] != key)
+            pos = (pos + 1) & mask_;
+        return pos;
+    }
+
+    /* backward-shift deletion keeps probe sequences intact */
+    void erase_index(size_t pos) {
+        size_t next = (pos + 1) & mask_;
+        while (table_[next] != EMPTY) {
+            size_t home = hash(keys_[table_[next]]);
+            /* move next into the hole unless its home lies in (pos, next] */
+            if (((next - home) & mask_) >= ((next - pos) & mask_)) {
+                table_[pos] = table_[next];
+                pos = next;
+            }
+            next = (next + 1) & mask_;
+        }
+        table_[pos] = EMPTY;
+    }
+
+    void unlink(uint32_t slot) {
+        if (prev_[slot] != EMPTY)
+            next_[prev_[slot]] = next_[slot];
+        else
+            head_ = next_[slot];
+        if (next_[slot] != EMPTY)
+            prev_[next_[slot]] = prev_[slot];
+        else
+            tail_ = prev_[slot];
+    }
+
+    void link_front(uint32_t slot) {
+        prev_[slot] = EMPTY;
+        next_[slot] = head_;
+        if (head_ != EMPTY) prev_[head_] = slot;
+        head_ = slot;
+        if (tail_ == EMPTY) tail_ = slot;
+    }
+
+    void move_to_front(uint32_t slot) {
+        if (slot == head_) return;
+        unlink(slot);
+        link_front(slot);
+    }
+
+    size_t capacity_;
+    size_t size_;
+    size_t mask_;
+    uint32_t head_;
+    uint32_t tail_;
+    std::vector<size_t> keys_;
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    std::vector<uint32_t> table_;
+    std::vector<uint32_t> free_;  // erased slots, reused first
+};
+
+/**
+ * @brief CLOCK (second chance): a hand sweeps the slots in a circle,
+ *        clearing reference bits, and evicts the first unreferenced slot.
+ */
+class clock_cache_t {
+   public:
+    explicit clock_cache_t(size_t capacity)
+        : capacity_(capacity), keys_(capacity), ref_(capacity) {
+        clear();
+    }
+
+    size_t find(size_t key, bool /* demand */ = true) {
+        auto it = map_.find(key);
+        if (it == map_.end()) return CACHE_NPOS;
+        ref_[it->second] = true;
+        return it->second;
+    }
+
+    size_t insert(size_t key, size_t& victim) {
+        size_t slot;
+        victim = CACHE_NPOS;
+        if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+            size_++;
+        } else if (size_ < capacity_) {
+            slot = size_++;
+        } else {
+            while (ref_[hand_]) {
+                ref_[hand_] = false;
+                hand_ = (hand_ + 1) % capacity_;
+            }
+            slot = hand_;
+            hand_ = (hand_ + 1) % capacity_;
+            victim = keys_[slot];
+            map_.erase(victim);
+        }
+        keys_[slot] = key;
+        ref_[slot] = true;
+        map_[key] = slot;
+        return slot;
+    }
+
+    bool erase(size_t key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) return false;
+        ref_[it->second] = false;
+        free_.push_back(it->second);
+        map_.erase(it);
+        size_--;
+        return true;
+    }
+
+    std::vector<size_t> keys() const {
+        std::vector<size_t> ret;
+        for (size_t n = 0; n < capacity_; ++n) {
+            size_t slot = (hand_ + n) % capacity_;
+            auto it = map_.find(keys_[slot]);
+            if (it != map_.end() && it->second == slot)
+                ret.push_back(keys_[slot]);
+        }
+        return ret;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        map_.clear();
+        free_.clear();
+        size_ = hand_ = 0;
+    }
+
+   private:
+    size_t capacity_;
+    size_t size_;
+    size_t hand_;
+    std::vector<size_t> keys_;
+    std::vector<bool> ref_;
+    std::unordered_map<size_t, size_t> map_;
+    std::vector<size_t> free_;  // erased slots, reused first
+};
+
+/**
+ * @brief 2Q (Johnson & Shasha, full version). First-time keys enter the
+ *        FIFO A1in; keys evicted from A1in are remembered in the ghost FIFO
+ *        A1out, and a miss on a remembered key promotes it into the LRU Am.
+ *        A one-pass scan therefore never flushes Am.
+ */
+class two_queue_t {
+   public:
+    explicit two_queue_t(size_t capacity)
+        : capacity_(capacity),
+          kin_(std::max<size_t>(1, capacity / 4)),
+          kout_(std::max<size_t>(1, capacity / 2)) {}
+
+    size_t find(size_t key, bool /* demand */ = true) {
+        auto it = map_.find(key);
+        if (it == map_.end() || it->second.where == A1OUT) return CACHE_NPOS;
+        auto& e = it->second;
+        if (e.where == AM) am_.splice(am_.begin(), am_, e.it);
+        return e.slot;  // hits in A1in do not reorder
+    }
+
+    size_t insert(size_t key, size_t& victim) {
+        size_t slot = reclaim(victim);
+        auto it = map_.find(key);
+        if (it != map_.end()) {  // remembered in A1out
+            a1out_.erase(it->second.it);
+            am_.push_front(key);
+            it->second = entry_t{AM, slot, am_.begin()};
+        } else {
+            a1in_.push_front(key);
+            map_[key] = entry_t{A1IN, slot, a1in_.begin()};
+        }
+        return slot;
+    }
+
+    size_t size() const { return a1in_.size() + am_.size(); }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        a1in_.clear();
+        a1out_.clear();
+        am_.clear();
+        map_.clear();
+    }
+
+   private:
+    enum where_t { A1IN, A1OUT, AM };
+    struct entry_t {
+        where_t where;
+        size_t slot;
+        std::list<size_t>::iterator it;
+    };
+
+    size_t reclaim(size_t& victim) {
+        victim = CACHE_NPOS;
+        if (size() < capacity_) return size();
+        size_t slot;
+        if (a1in_.size() > kin_ || am_.empty()) {
+            victim = a1in_.back();
+            a1in_.pop_back();
+            auto& e = map_[victim];
+            slot = e.slot;
+            a1out_.push_front(victim);
+            e = entry_t{A1OUT, CACHE_NPOS, a1out_.begin()};
+            if (a1out_.size() > kout_) {
+                map_.erase(a1out_.back());
+                a1out_.pop_back();
+            }
+        } else {
+            victim = am_.back();
+            am_.pop_back();
+            slot = map_[victim].slot;
+            map_.erase(victim);
+        }
+        return slot;
+    }
+
+    size_t capacity_;
+    size_t kin_;
+    size_t kout_;
+    std::list<size_t> a1in_;
+    std::list<size_t> a1out_;
+    std::list<size_t> am_;
+    std::unordered_map<size_t, entry_t> map_;
+};
+
+/**
+ * @brief ARC (Megiddo & Modha). T1 holds keys seen once recently, T2 keys
+ *        seen at least twice; the ghost lists B1/B2 remember what was
+ *        evicted from each, and ghost hits move the target size p of T1.
+ */
+class arc_t {
+   public:
+    explicit arc_t(size_t capacity) : capacity_(capacity), p_(0) {}
+
+    size_t find(size_t key, bool /* demand */ = true) {
+        auto it = map_.find(key);
+        if (it == map_.end()) return CACHE_NPOS;
+        auto& e = it->second;
+        if (e.where != T1 && e.where != T2) return CACHE_NPOS;
+        move_to(e, key, T2);
+        return e.slot;
+    }
+
+    size_t insert(size_t key, size_t& victim) {
+        victim = CACHE_NPOS;
+        size_t slot = CACHE_NPOS;
+        auto it = map_.find(key);
+        if (it != map_.end() && it->second.where == B1) {
+            double delta =
+                std::max(1.0, 1.0 * list(B2).size() / list(B1).size());
+            p_ = std::min(double(capacity_), p_ + delta);
+            slot = replace(false, victim);
+            move_to(map_[key], key, T2);
+        } else if (it != map_.end() && it->second.where == B2) {
+            double delta =
+                std::max(1.0, 1.0 * list(B1).size() / list(B2).size());
+            p_ = std::max(0.0, p_ - delta);
+            slot = replace(true, victim);
+            move_to(map_[key], key, T2);
+        } else {
+            size_t l1 = list(T1).size() + list(B1).size();
+            size_t total = l1 + list(T2).size() + list(B2).size();
+            if (l1 == capacity_) {
+                if (list(T1).size() < capacity_) {
+                    drop_lru(B1);
+                    slot = replace(false, victim);
+                } else {
+                    victim = list(T1).back();
+                    slot = map_[victim].slot;
+                    drop_lru(T1);
+                }
+            } else if (total >= capacity_) {
+                if (total == 2 * capacity_) drop_lru(B2);
+                slot = replace(false, victim);
+            }
+            auto& e = map_[key];
+            e.where = NONE;
+            move_to(e, key, T1);
+        }
+        if (slot == CACHE_NPOS) slot = resident() - 1;  // cache not full yet
+        map_[key].slot = slot;
+        return slot;
+    }
+
+    size_t size() const { return resident(); }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        for (auto& l : lists_) l.clear();
+        map_.clear();
+        p_ = 0;
+    }
+
+   private:
+    enum where_t { T1, T2, B1, B2, NONE };
+    struct entry_t {
+        where_t where;
+        size_t slot;
+        std::list<size_t>::iterator it;
+    };
+
+    std::list<size_t>& list(where_t w) { return lists_[w]; }
+    size_t resident() const { return lists_[T1].size() + lists_[T2].size(); }
+
+    void move_to(entry_t& e, size_t key, where_t to) {
+        if (e.where != NONE) list(e.where).erase(e.it);
+        list(to).push_front(key);
+        e.where = to;
+        e.it = list(to).begin();
+    }
+
+    void drop_lru(where_t w) {
+        map_.erase(list(w).back());
+        list(w).pop_back();
+    }
+
+    /* demote the LRU end of T1 or T2 into its ghost list, free its slot */
+    size_t replace(bool in_b2, size_t& victim) {
+        if (resident() < capacity_) return CACHE_NPOS;
+        size_t t1 = list(T1).size();
+        where_t from = (t1 >= 1 && ((in_b2 && t1 == size_t(p_)) || t1 > p_))
+                           ? T1
+                           : T2;
+        if (list(from).empty()) from = from == T1 ? T2 : T1;
+        victim = list(from).back();
+        auto& e = map_[victim];
+        size_t slot = e.slot;
+        move_to(e, victim, from == T1 ? B1 : B2);
+        e.slot = CACHE_NPOS;
+        return slot;
+    }
+
+    size_t capacity_;
+    double p_;  // target size of T1
+    std::list<size_t> lists_[4];
+    std::unordered_map<size_t, entry_t> map_;
+};
+
+/**
+ * @brief LIRS (Jiang & Zhang). Keys with a short inter-reference recency
+ *        (LIR) keep most of the cache; the remaining 1% holds HIR keys in
+ *        the FIFO Q. The recency stack S also remembers recently seen
+ *        non-resident HIR keys, so a key re-referenced while still in S is
+ *        promoted to LIR.
+ */
+class lirs_t {
+   public:
+    explicit lirs_t(size_t capacity)
+        : capacity_(capacity),
+          lir_limit_(capacity > 1
+                         ? capacity - std::max<size_t>(1, capacity / 100)
+                         : capacity),
+          lir_count_(0),
+          resident_(0) {}
+
+    size_t find(size_t key, bool /* demand */ = true) {
+        auto it = map_.find(key);
+        if (it == map_.end() || it->second.state == HIR_NONRESIDENT)
+            return CACHE_NPOS;
+        auto& e = it->second;
+        if (e.state == LIR) {
+            push_top(e, key);
+            prune();
+        } else if (e.in_s) {  // resident HIR with small recency: promote
+            q_.erase(e.q_it);
+            e.in_q = false;
+            e.state = LIR;
+            lir_count_++;
+            push_top(e, key);
+            demote_bottom();
+        } else {  // resident HIR, stays HIR
+            push_top(e, key);
+            q_.erase(e.q_it);
+            push_q(e, key);
+        }
+        return e.slot;
+    }
+
+    size_t insert(size_t key, size_t& victim) {
+        victim = CACHE_NPOS;
+        size_t slot;
+        if (resident_ < capacity_) {
+            slot = resident_;
+        } else {
+            slot = evict(victim);
+        }
+        resident_++;
+
+        auto& e = map_[key];  // new, or a non-resident HIR still in S
+        e.slot = slot;
+        if (lir_count_ < lir_limit_) {
+            e.state = LIR;
+            lir_count_++;
+            push_top(e, key);
+        } else if (e.in_s) {
+            e.state = LIR;
+            lir_count_++;
+            push_top(e, key);
+            demote_bottom();
+        } else {
+            e.state = HIR_RESIDENT;
+            push_top(e, key);
+            push_q(e, key);
+        }
+        return slot;
+    }
+
+    size_t size() const { return resident_; }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        s_.clear();
+        q_.clear();
+        map_.clear();
+        lir_count_ = resident_ = 0;
+    }
+
+   private:
+    enum state_t { LIR, HIR_RESIDENT, HIR_NONRESIDENT };
+    struct entry_t {
+        state_t state = HIR_NONRESIDENT;
+        size_t slot = CACHE_NPOS;
+        bool in_s = false;
+        bool in_q = false;
+        std::list<size_t>::iterator s_it;
+        std::list<size_t>::iterator q_it;
+    };
+
+    void push_top(entry_t& e, size_t key) {
+        if (e.in_s) s_.erase(e.s_it);
+        s_.push_front(key);
+        e.s_it = s_.begin();
+        e.in_s = true;
+    }
+
+    void push_q(entry_t& e, size_t key) {
+        q_.push_back(key);
+        e.q_it = std::prev(q_.end());
+        e.in_q = true;
+    }
+
+    /* remove HIR entries from the bottom of S until it ends with a LIR key */
+    void prune() {
+        while (!s_.empty()) {
+            auto key = s_.back();
+            auto it = map_.find(key);
+            if (it->second.state == LIR) break;
+            s_.pop_back();
+            it->second.in_s = false;
+            if (it->second.state == HIR_NONRESIDENT) map_.erase(it);
+        }
+    }
+
+    /* too many LIR keys: the bottom of S becomes a resident HIR */
+    void demote_bottom() {
+        if (lir_count_ <= lir_limit_) return;
+        prune();
+        auto key = s_.back();
+        auto& e = map_[key];
+        s_.pop_back();
+        e.in_s = false;
+        e.state = HIR_RESIDENT;
+        lir_count_--;
+        push_q(e, key);
+        prune();
+    }
+
+    /* evict the front of Q, or the bottom LIR key if Q is empty */
+    size_t evict(size_t& victim) {
+        if (q_.empty()) {
+            prune();
+            victim = s_.back();
+            auto& e = map_[victim];
+            s_.pop_back();
+            size_t slot = e.slot;
+            map_.erase(victim);
+            lir_count_--;
+            resident_--;
+            prune();
+            return slot;
+        }
+        victim = q_.front();
+        q_.pop_front();
+        auto& e = map_[victim];
+        size_t slot = e.slot;
+        e.in_q = false;
+        e.slot = CACHE_NPOS;
+        e.state = HIR_NONRESIDENT;
+        if (!e.in_s) map_.erase(victim);
+        resident_--;
+        return slot;
+    }
+
+    size_t capacity_;
+    size_t lir_limit_;
+    size_t lir_count_;
+    size_t resident_;
+    std::list<size_t> s_;  // recency stack, top at front
+    std::list<size_t> q_;  // resident HIR keys, evicted from the front
+    std::unordered_map<size_t, entry_t> map_;
+};
+
+/**
+ * @brief Wraps an engine and records the key of every demand find(). The
+ *        demand lookups buffer_t makes do not depend on the policy, so a
+ *        recorded run can drive opt_t afterwards.
+ */
+template <class Cache>
+class trace_recorder_t : public Cache {
+   public:
+    explicit trace_recorder_t(size_t capacity) : Cache(capacity) {}
+
+    size_t find(size_t key, bool demand = true) {
+        if (demand) trace.push_back(key);
+        return Cache::find(key, demand);
+    }
+
+    std::vector<size_t> trace;
+};
+
+/**
+ * @brief Belady's OPT computed offline: given the demand trace recorded by
+ *        trace_recorder_t, evicts the resident key whose next demand use
+ *        lies farthest in the future. Keys are always admitted.
+ */
+class opt_t {
+   public:
+    opt_t(size_t capacity, const std::vector<size_t>& trace)
+        : capacity_(capacity), slot_next_(capacity) {
+        for (size_t t = 0; t < trace.size(); ++t) uses_[trace[t]].push_back(t);
+        clear();
+    }
+
+    size_t find(size_t key, bool demand = true) {
+        if (demand) pos_++;
+        cur_next_ = next_use(key);
+        auto it = map_.find(key);
+        if (it == map_.end()) return CACHE_NPOS;
+        size_t slot = it->second;
+        order_.erase({slot_next_[slot], slot});
+        slot_next_[slot] = cur_next_;
+        order_.insert({cur_next_, slot});
+        return slot;
+    }
+
+    /* must follow the find() that missed on key */
+    size_t insert(size_t key, size_t& victim) {
+        size_t slot;
+        victim = CACHE_NPOS;
+        if (map_.size() < capacity_) {
+            slot = map_.size();
+        } else {
+            auto farthest = std::prev(order_.end());
+            slot = farthest->second;
+            order_.erase(farthest);
+            victim = keys_[slot];
+            map_.erase(victim);
+        }
+        keys_[slot] = key;
+        map_[key] = slot;
+        slot_next_[slot] = cur_next_;
+        order_.insert({cur_next_, slot});
+        return slot;
+    }
+
+    size_t size() const { return map_.size(); }
+    size_t capacity() const { return capacity_; }
+    void clear() {
+        map_.clear();
+        order_.clear();
+        keys_.assign(capacity_, 0);
+        pos_ = 0;
+        cur_next_ = NEVER;
+    }
+
+   private:
+    static constexpr size_t NEVER = SIZE_MAX;
+
+    /* first demand use of key at or after the current position */
+    size_t next_use(size_t key) const {
+        auto it = uses_.find(key);
+        if (it == uses_.end()) return NEVER;
+        auto& uses = it->second;
+        auto next = std::lower_bound(uses.begin(), uses.end(), pos_);
+        return next == uses.end() ? NEVER : *next;
+    }
+
+    size_t capacity_;
+    size_t pos_;       // demand lookups seen so far
+    size_t cur_next_;  // next use of the key looked up last
+    std::vector<size_t> slot_next_;
+    std::vector<size_t> keys_;
+    std::set<std::pair<size_t, size_t>> order_;  // (next use, slot)
+    std::unordered_map<size_t, size_t> map_;
+    std::unordered_map<size_t, std::vector<size_t>> uses_;
+};
+
+#endif
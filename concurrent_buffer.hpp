@@ -0,0 +1,167 @@
+/**
+ * @file concurrent_buffer.hpp
+ * @author HUANG Qiyue
+ * @brief A buffer_t that many threads can share.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * The lines of the matrix are hashed onto shards; each shard is a plain
+ * buffer_t over its own handle of the file, with its own lock and its own
+ * share of the capacity. Threads on different shards never wait for each
+ * other.
+ *
+ * Threads access the buffer through a worker_t, which keeps that thread's
+ * counters and adds them to the buffer's totals when it goes away.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef CONCURRENT_BUFFER_H
+#define CONCURRENT_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cache_engines.hpp"
+#include "storage.hpp"
+#include "structures.hpp"
+
+/**
+ * @brief Sharded, thread-safe buffer of a matrix_t<T> file.
+ *
+ * A shard caches only the lines hashed to it, so the window pre-fetch of
+ * buffer_t, which walks into the lines of other shards, is not offered:
+ * every shard runs with window 1.
+ *
+ * @tparam T Type of variables stored in the matrix.
+ * @tparam Cache Replacement engine of every shard, see cache_engines.hpp.
+ */
+template <class T, class Cache = flat_lru_t>
+class concurrent_buffer_t {
+   private:
+    struct shard_t;
+
+   public:
+    /* a thread's view of the buffer, not to be shared between threads */
+    class worker_t {
+       private:
+        struct vector_t;
+
+       public:
+        explicit worker_t(concurrent_buffer_t* _parent) : parent(_parent) {}
+        worker_t(worker_t&& other)
+            : parent(other.parent),
+              read_count(other.read_count),
+              miss_count(other.miss_count),
+              write_count(other.write_count) {
+            other.parent = nullptr;
+        }
+        ~worker_t() {
+            if (!parent) return;
+            parent->read_count += read_count;
+            parent->miss_count += miss_count;
+            parent->write_count += write_count;
+        }
+
+        vector_t operator[](size_t i) { return vector_t(i, this); }
+
+        T read(size_t i, size_t j) {
+            auto& shard = parent->shard_of(i, j);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto before = shard.buffer.miss_count;
+            auto ret = shard.buffer.read(i, j);
+            read_count++;
+            miss_count += shard.buffer.miss_count - before;
+            return ret;
+        }
+
+        void assign(size_t i, size_t j, T val) {
+            auto& shard = parent->shard_of(i, j);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.buffer.assign(i, j, val);
+            write_count++;
+        }
+
+        concurrent_buffer_t* parent;
+        uint64_t read_count = 0;
+        uint64_t miss_count = 0;
+        uint64_t write_count = 0;
+
+       private:
+        /* proxy class */
+        struct vector_t {
+            size_t i;
+            worker_t* parent;
+            vector_t(size_t _i, worker_t* e) : i(_i), parent(e) {}
+
+            /* read only; use assign() to write */
+            const T operator[](size_t j) const { return parent->read(i, j); }
+        };
+    };
+
+    concurrent_buffer_t(char const* filename, size_t capacity, size_t nshards,
+                        size_t _line_size = 1,
+                        write_policy_t write_policy = WRITE_THROUGH,
+                        storage_mode_t storage_mode = STORAGE_FSTREAM)
+        : line_size(_line_size) {
+        nshards = std::max<size_t>(nshards, 1);
+        for (size_t s = 0; s < nshards; ++s) {
+            /* spread capacity, the first shards take the remainder */
+            size_t share = capacity / nshards + (s < capacity % nshards);
+            share = std::max<size_t>(share, 1);
+            shards.emplace_back(new shard_t(filename, share, line_size,
+                                            write_policy, storage_mode));
+        }
+        reset_counters();
+    }
+
+    worker_t worker() { return worker_t(this); }
+
+    /* write every dirty line of every shard back */
+    void flush() {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            shard->buffer.flush();
+        }
+    }
+
+    /* call between runs, when no worker is alive */
+    void reset_counters() {
+        read_count = miss_count = write_count = 0;
+        for (auto& shard : shards) shard->buffer.reset_counters();
+    }
+
+    inline float miss_rate() { return 1.0f * miss_count / read_count; }
+
+    size_t shard_count() const { return shards.size(); }
+
+    /* totals of all workers that have finished */
+    std::atomic<uint64_t> read_count;
+    std::atomic<uint64_t> miss_count;
+    std::atomic<uint64_t> write_count;
+
+   private:
+    struct alignas(64) shard_t {
+        shard_t(char const* filename, size_t capacity, size_t line_size,
+                write_policy_t write_policy, storage_mode_t storage_mode)
+            : buffer(filename, capacity, 1, line_size, write_policy,
+                     storage_mode) {}
+        std::mutex lock;
+        buffer_t<T, Cache> buffer;
+    };
+
+    /* every shard maps keys alike, so shard 0 can be asked without a lock */
+    shard_t& shard_of(size_t i, size_t j) {
+        size_t line = shards[0]->buffer.key_of(i, j) / line_size;
+        size_t h = (line * 0x9E3779B97F4A7C15ULL) >> 32;
+        return *shards[h % shards.size()];
+    }
+
+    size_t line_size;
+    std::vector<std::unique_ptr<shard_t>> shards;
+};
+
+#endif
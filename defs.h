@@ -13,9 +13,15 @@
 #define DEFS_H
 
 /* Phase 1 */
-#define MAGIC 0x114514
-#define MATRIX_METADATA 4
-#define MATRIX_ARR_OFFSET (MATRIX_METADATA*sizeof(uint32_t))
+#define MAGIC 0x114515 /* 0x114514 files had a 16- or 20-byte header */
+#define MATRIX_METADATA 6 /* magic, row, col, size_of_T, layout, header size */
+#define MATRIX_ARR_OFFSET (MATRIX_METADATA*sizeof(uint32_t)) /* 8-aligned */
+#define MATRIX_ALIGNMENT 64 /* bytes, one cache line */
+
+#define TRACE_MAGIC 0x7ACE
+#define TRACE_PREFIX "trace_"
+
+#define SNAPSHOT_MAGIC 0x5A45
 
 /* Phase 2 */
 #define INPUT_BUFFER_PROPORTION 0.2
@@ -24,6 +30,12 @@
 
 #define DUMPED_SMALL_SUFFIX ".s"
 #define DUMPED_LARGE_SUFFIX ".l"
+#define DUMPED_BUCKET_SUFFIX ".b"
+
+#define DISTRIBUTION_MAX_WAYS 256   /* bucket files open in one pass */
+#define DISTRIBUTION_BLOCK 4096     /* bytes, smallest bucket buffer */
+#define DISTRIBUTION_OVERSAMPLE 32  /* sampled keys per bucket */
+#define SAMPLE_RUN 16               /* consecutive keys per sample read */
 
 /* Phase 3 */
 #define DUMPED_RUN_PREFIX "run_"
@@ -15,14 +15,20 @@
 
 //#define DEBUG
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <mutex>
+#include <random>
 #include <sstream>
 
 #include "defs.h"
 #include "structures.hpp"
+#include "task_pool.hpp"
 
 #define PRINT_TIME_SO_FAR                                            \
     std::cout << "Elasped time: "                                    \
@@ -36,18 +42,22 @@
 
 const clock_t begin_time = clock();  // time at initialization
 
-unsigned long disk_read_count = 0;
-unsigned long disk_write_count = 0;
+std::atomic<unsigned long> disk_read_count(0);   // read calls
+std::atomic<unsigned long> disk_write_count(0);  // write calls
+std::atomic<unsigned long long> disk_read_bytes(0);
+std::atomic<unsigned long long> disk_write_bytes(0);
 
 unsigned long TOTAL_MEM;
-unsigned long INPUT_BUFFER_MEM;
-unsigned long INPUT_BUFFER_SIZE;
-unsigned long SMALL_GROUP_MEM;
-unsigned long SMALL_GROUP_SIZE;
-unsigned long LARGE_GROUP_MEM;
-unsigned long LARGE_GROUP_SIZE;
-unsigned long MIDDLE_GROUP_MEM;
-unsigned long MIDDLE_GROUP_SIZE;
+
+/* modes */
+bool IN_MEMORY_LEAVES = true;  // sort partitions that fit TOTAL_MEM in memory
+unsigned long THREADS = 1;     // workers sorting subtrees in parallel
+bool DISTRIBUTE = false;       // k-way distribution sort, see ext_dist_sort
+bool EQUAL_RANGE = true;       // count keys equal to the middle min or max
+bool DIRECT_PLACEMENT = false; // write partitions at their output offsets
+bool INTERVAL_HEAP = true;     // middle group heap, else MinMaxHeap
+
+std::mutex log_mutex;  // one pass prints at a time
 
 template <typename T>
 bool is_sorted(const std::string input_name, bool ascending = true) {
@@ -76,19 +86,164 @@ bool is_sorted(const std::string input_name, bool ascending = true) {
     return true;
 }
 
+/* fill buffer with up to its capacity of elements in one read */
+template <typename T>
+void read_block(std::ifstream& fs, std::vector<T>& buffer) {
+    buffer.resize(buffer.capacity());
+    fs.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(T));
+    buffer.resize(fs.gcount() / sizeof(T));
+    disk_read_count++;
+    disk_read_bytes += fs.gcount();
+}
+
+/* write n elements in one write */
+template <typename T>
+void write_block(std::ofstream& fs, const T* data, size_t n) {
+    if (n == 0) return;
+    fs.write(reinterpret_cast<const char*>(data), n * sizeof(T));
+    disk_write_count++;
+    disk_write_bytes += n * sizeof(T);
+}
+
+/* write n elements at byte offset of fd, one pwrite unless it comes short;
+ * false if the data did not all make it */
+template <typename T>
+bool write_block_at(int fd, unsigned long long offset, const T* data,
+                    size_t n) {
+    auto bytes = reinterpret_cast<const char*>(data);
+    size_t left = n * sizeof(T);
+    while (left) {
+        auto written = pwrite(fd, bytes, left, offset);
+        if (written <= 0) {
+            std::cerr << "Error writing output at " << offset << "\n";
+            return false;
+        }
+        bytes += written;
+        left -= written;
+        offset += written;
+    }
+    disk_write_count++;
+    disk_write_bytes += n * sizeof(T);
+    return true;
+}
+
+/**
+ * @brief Empties group into the partition file save_name, which stays open
+ *        in fs for the rest of the pass. The first dump creates the file
+ *        and the child node.
+ */
 template <typename T>
-void ext_qsort(TreeNode<std::string>* cur_node) {
+void dump_group(std::vector<T>& group, std::ofstream& fs,
+                TreeNode<std::string>*& child, const std::string& save_name) {
+    // save structure to binary tree
+    if (!child) child = new TreeNode<std::string>(save_name);
+    // write to disk!
+    if (!fs.is_open()) {
+        fs.open(save_name, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fs) {
+            std::cerr << "Error opening file: " << save_name << "\n";
+        }
+    }
+    write_block(fs, group.data(), group.size());
+    group.clear();
+}
+
+/**
+ * @brief Moves count copies of key, counted in the middle group's equal
+ *        range, into group, dumping group whenever it reaches capacity.
+ */
+template <typename T>
+void spill_equal(const T& key, unsigned long long& count,
+                 std::vector<T>& group, unsigned long capacity,
+                 std::ofstream& fs, TreeNode<std::string>*& child,
+                 const std::string& save_name) {
+    for (; count; --count) {
+        group.push_back(key);
+        if (group.size() >= capacity) dump_group(group, fs, child, save_name);
+    }
+}
+
+/**
+ * @brief Sorts the whole file in memory, one read and one write: back to
+ *        the file, or at byte offset of out_fd when one is given.
+ * @return false if the file could not be read or the sorted data written.
+ */
+template <typename T>
+bool sort_in_memory(const std::string& name, unsigned long long size,
+                    int out_fd = -1, unsigned long long offset = 0) {
+    std::vector<T> data;
+    data.reserve(size / sizeof(T));
+    {
+        std::ifstream fs(name, std::ios::in | std::ios::binary);
+        read_block(fs, data);
+    }
+    if (data.size() * sizeof(T) != size) {
+        std::cerr << "Unable to read file " << name << " !" << std::endl;
+        return false;
+    }
+    std::sort(data.begin(), data.end());
+    if (out_fd >= 0)
+        return write_block_at(out_fd, offset, data.data(), data.size());
+    std::ofstream fs(name, std::ios::out | std::ios::binary);
+    write_block(fs, data.data(), data.size());
+    fs.close();
+    return !fs.fail();
+}
+
+/* keys in each group of a partition pass with mem bytes */
+template <typename T>
+struct pass_groups_t {
+    unsigned long input, small, large, middle;
+
+    explicit pass_groups_t(unsigned long mem) {
+        unsigned long input_mem = mem * INPUT_BUFFER_PROPORTION;
+        unsigned long small_mem = mem * SMALL_GROUP_PROPORTION;
+        unsigned long large_mem = mem * LARGE_GROUP_PROPORTION;
+        input = input_mem / sizeof(T);
+        small = small_mem / sizeof(T);
+        large = large_mem / sizeof(T);
+        middle = (mem - input_mem - small_mem - large_mem) / sizeof(T);
+    }
+
+    /* an empty group would end the pass early, as if at the end of file,
+     * and truncate the file when the middle group is written back */
+    bool usable() const { return input && small && large && middle; }
+};
+
+/* the least memory of a pass that partitions on disk */
+template <typename T>
+unsigned long min_pass_mem() {
+    unsigned long mem = sizeof(T);
+    while (!pass_groups_t<T>(mem).usable()) ++mem;
+    return mem;
+}
+
+/**
+ * @brief One pass over cur_node->data with mem bytes: the middle group is
+ *        written back sorted in its place, and the small and large groups
+ *        go to the .s and .l files of new children. A file that fits mem
+ *        is just sorted in memory when IN_MEMORY_LEAVES is set.
+ *
+ * Given out_fd, the subtree of cur_node owns the bytes of the output from
+ * base on, and the sorted middle group (or the whole sorted file) is
+ * written straight to its place there instead of to cur_node->data.
+ *
+ * Bytes written to the small and large children go to dumped.
+ *
+ * @return false on an I/O error, or, with the file left as it is, if mem is
+ *         below min_pass_mem(); the children made so far stay in the tree.
+ */
+template <typename T, class Heap>
+bool partition_with(TreeNode<std::string>* cur_node, unsigned long mem,
+                    int out_fd, unsigned long long base,
+                    std::pair<unsigned long long, unsigned long long>& dumped) {
     /* init parameters */
     std::string input_name = cur_node->data;
-    INPUT_BUFFER_MEM = TOTAL_MEM * INPUT_BUFFER_PROPORTION;
-    INPUT_BUFFER_SIZE = INPUT_BUFFER_MEM / sizeof(T);
-    SMALL_GROUP_MEM = TOTAL_MEM * SMALL_GROUP_PROPORTION;
-    SMALL_GROUP_SIZE = SMALL_GROUP_MEM / sizeof(T);
-    LARGE_GROUP_MEM = LARGE_GROUP_MEM * LARGE_GROUP_PROPORTION;
-    LARGE_GROUP_SIZE = LARGE_GROUP_MEM / sizeof(T);
-    MIDDLE_GROUP_MEM =
-        TOTAL_MEM - INPUT_BUFFER_MEM - SMALL_GROUP_MEM - LARGE_GROUP_MEM;
-    MIDDLE_GROUP_SIZE = MIDDLE_GROUP_MEM / sizeof(T);
+    pass_groups_t<T> groups(mem);
+    unsigned long input_buffer_size = groups.input;
+    unsigned long small_group_size = groups.small;
+    unsigned long large_group_size = groups.large;
+    unsigned long middle_group_size = groups.middle;
 
     /* open file */
     std::ifstream input;
@@ -96,39 +251,64 @@ void ext_qsort(TreeNode<std::string>* cur_node) {
 
     if (!input.good()) {
         std::cerr << "Unable to read file " << input_name << " !" << std::endl;
-        exit(-1);
+        return false;
     }
 
     /* get size */
-    unsigned int input_size;
+    unsigned long long input_size;
     input.seekg(0, input.end);
     input_size = input.tellg();
     input.seekg(0, input.beg);
-    PRINT_SEPARATOR_START;
 
-    std::cout << "Reading file " << input_name << " !" << std::endl;
-    std::cout << "Total size (in bytes): " << input_size << std::endl;
-    std::cout << "Total items: " << input_size / sizeof(T) << std::endl;
+    if (IN_MEMORY_LEAVES && input_size <= mem) {
+        input.close();
+        dumped = {0, 0};
+        if (!sort_in_memory<T>(input_name, input_size, out_fd, base))
+            return false;
+        std::lock_guard<std::mutex> guard(log_mutex);
+        PRINT_SEPARATOR_START;
+        std::cout << "Sorted " << input_name << " in memory!" << std::endl;
+        std::cout << "Total size (in bytes): " << input_size << std::endl;
+        PRINT_TIME_SO_FAR;
+        PRINT_SEPARATOR_END;
+        return true;
+    }
+
+    if (!groups.usable()) {
+        std::cerr << "Memory of " << mem << " bytes is too small to partition "
+                  << input_name << ", left as it is." << std::endl;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(log_mutex);
+        PRINT_SEPARATOR_START;
+        std::cout << "Reading file " << input_name << " !" << std::endl;
+        std::cout << "Total size (in bytes): " << input_size << std::endl;
+        std::cout << "Total items: " << input_size / sizeof(T) << std::endl;
+        std::cout << "Memory: " << mem << std::endl;
+        PRINT_SEPARATOR_END;
+    }
 
     /* init reader */
-    ext_qsort_t<T> manager(INPUT_BUFFER_SIZE, SMALL_GROUP_SIZE,
-                           LARGE_GROUP_SIZE, MIDDLE_GROUP_SIZE);
+    ext_qsort_t<T, Heap> manager(input_buffer_size, small_group_size,
+                                 large_group_size, middle_group_size);
 
-    PRINT_SEPARATOR_END;
+    /* partition files, open for the whole pass */
+    std::ofstream small_fs, large_fs;
 
-    PRINT_SEPARATOR_START;
-    while (!input.eof()) {
+    /* keys equal to the middle group's min and max, counted, not stored */
+    unsigned long long equal_min = 0, equal_max = 0;
+    auto small_name = cur_node->data + DUMPED_SMALL_SUFFIX;
+    auto large_name = cur_node->data + DUMPED_LARGE_SUFFIX;
+
+    while (true) {
         /* feed input_buffer */
-        while (manager.input_buffer.size() < INPUT_BUFFER_SIZE &&
-               !input.eof()) {
-            T cur_data;
-            input.read((char*)&cur_data, sizeof(T));
-            disk_read_count++;
-            if (!input.eof()) manager.input_buffer.push_back(cur_data);
-        }
+        read_block(input, manager.input_buffer);
+        if (manager.input_buffer.empty()) break;
 
         /* digest fed data */
-        while (manager.middle_group.size() < MIDDLE_GROUP_SIZE &&
+        while (manager.middle_group.size() < middle_group_size &&
                !manager.input_buffer.empty()) {
             T cur_data = manager.input_buffer.back();
             manager.input_buffer.pop_back();
@@ -143,59 +323,39 @@ void ext_qsort(TreeNode<std::string>* cur_node) {
                 manager.large_group.push_back(cur_data);
             } else if (cur_data < smallest) {
                 manager.small_group.push_back(cur_data);
+            } else if (EQUAL_RANGE && cur_data == smallest) {
+                equal_min++;
+            } else if (EQUAL_RANGE && cur_data == largest) {
+                equal_max++;
             } else {  // between min and max
                 /* balancing */
                 if (manager.large_group.size() > manager.small_group.size()) {
-                    auto ele = manager.middle_group.popMin();
+                    auto ele = replace_min(manager.middle_group, cur_data);
                     manager.small_group.push_back(ele);
-                    manager.middle_group.push(cur_data);
+                    /* copies of a min that is gone now belong below it */
+                    if (equal_min && manager.middle_group.findMin() != ele)
+                        spill_equal(ele, equal_min, manager.small_group,
+                                    small_group_size, small_fs,
+                                    cur_node->LeftChild, small_name);
                 } else {
-                    auto ele = manager.middle_group.popMax();
+                    auto ele = replace_max(manager.middle_group, cur_data);
                     manager.large_group.push_back(ele);
-                    manager.middle_group.push(cur_data);
+                    if (equal_max && manager.middle_group.findMax() != ele)
+                        spill_equal(ele, equal_max, manager.large_group,
+                                    large_group_size, large_fs,
+                                    cur_node->RightChild, large_name);
                 }
             }
 
-            if (manager.large_group.size() >= LARGE_GROUP_SIZE) {
-                // save structure to binary tree
-                auto save_name = cur_node->data + DUMPED_LARGE_SUFFIX;
-                if (!cur_node->RightChild)
-                    cur_node->RightChild = new TreeNode<std::string>(save_name);
-                // write to disk!
-                std::fstream fs(save_name, std::ios::out | std::ios::binary |
-                                               std::ios::app);
-                if (!fs) {
-                    std::cerr << "Error opening file: " << save_name << "\n";
-                }
-                while (!manager.large_group.empty()) {
-                    T data_to_save = manager.large_group.back();
-                    manager.large_group.pop_back();
-                    fs.write(reinterpret_cast<char*>(&data_to_save), sizeof(T));
-                    disk_write_count++;
-                }
-                fs.close();
-            }
-            if (manager.small_group.size() >= SMALL_GROUP_SIZE) {
-                // save structure to binary tree
-                auto save_name = cur_node->data + DUMPED_SMALL_SUFFIX;
-                if (!cur_node->LeftChild)
-                    cur_node->LeftChild = new TreeNode<std::string>(save_name);
-                // write to disk!
-                std::fstream fs(save_name, std::ios::out | std::ios::binary |
-                                               std::ios::app);
-                if (!fs) {
-                    std::cerr << "Error opening file: " << save_name << "\n";
-                }
-                while (!manager.small_group.empty()) {
-                    T data_to_save = manager.small_group.back();
-                    manager.small_group.pop_back();
-                    fs.write(reinterpret_cast<char*>(&data_to_save), sizeof(T));
-                    disk_write_count++;
-                }
-                fs.close();
-            }
+            if (manager.large_group.size() >= large_group_size)
+                dump_group(manager.large_group, large_fs,
+                           cur_node->RightChild, large_name);
+            if (manager.small_group.size() >= small_group_size)
+                dump_group(manager.small_group, small_fs, cur_node->LeftChild,
+                           small_name);
         }
     }
+    input.close();
 
 #ifdef DEBUG
     std::cout << "large group: " << manager.large_group.size() << std::endl;
@@ -215,61 +375,64 @@ void ext_qsort(TreeNode<std::string>* cur_node) {
     std::cout << std::endl;
 #endif
 
-    /* write middle group to disk! */
-    {
-        std::fstream fs(cur_node->data,
-                        std::ios::out | std::ios::binary);  // no std::ios::app
-        if (!fs) {
-            std::cerr << "Error opening file: " << cur_node->data << "\n";
-        }
-
-        while (!manager.middle_group.empty()) {
-            T data_to_save = manager.middle_group.popMin();  // ascending order
-            fs.write(reinterpret_cast<char*>(&data_to_save), sizeof(T));
-            disk_write_count++;
-        }
-        fs.close();
+    /* write small and large groups to disk! */
+    if (!manager.large_group.empty())
+        dump_group(manager.large_group, large_fs, cur_node->RightChild,
+                   large_name);
+    if (!manager.small_group.empty())
+        dump_group(manager.small_group, small_fs, cur_node->LeftChild,
+                   small_name);
+    dumped = {0, 0};
+    if (small_fs.is_open()) dumped.first = small_fs.tellp();
+    if (large_fs.is_open()) dumped.second = large_fs.tellp();
+    bool good = true;
+    for (auto fs : {&small_fs, &large_fs}) {
+        if (!fs->is_open()) continue;
+        fs->close();
+        good = good && !fs->fail();
     }
 
-    /* write small and large groups to disk! */
-    if (!manager.large_group.empty()) {
-        // save structure to binary tree
-        auto save_name = cur_node->data + DUMPED_LARGE_SUFFIX;
-        if (!cur_node->RightChild)
-            cur_node->RightChild = new TreeNode<std::string>(save_name);
-        // write to disk!
-        std::fstream fs(save_name,
-                        std::ios::out | std::ios::binary | std::ios::app);
-        if (!fs) {
-            std::cerr << "Error opening file: " << save_name << "\n";
-        }
-        while (!manager.large_group.empty()) {
-            T data_to_save = manager.large_group.back();
-            manager.large_group.pop_back();
-            fs.write(reinterpret_cast<char*>(&data_to_save), sizeof(T));
-            disk_write_count++;
+    /* write middle group to disk, staged through the empty input buffer */
+    {
+        std::ofstream fs;
+        if (out_fd < 0) {
+            fs.open(cur_node->data,
+                    std::ios::out | std::ios::binary);  // no append
+            if (!fs) {
+                std::cerr << "Error opening file: " << cur_node->data
+                          << "\n";
+            }
         }
-        fs.close();
-    }
+        unsigned long long offset = base + dumped.first;  // if out_fd
 
-    if (!manager.small_group.empty()) {
-        // save structure to binary tree
-        auto save_name = cur_node->data + DUMPED_SMALL_SUFFIX;
-        if (!cur_node->LeftChild)
-            cur_node->LeftChild = new TreeNode<std::string>(save_name);
-        // write to disk!
-        std::fstream fs(save_name,
-                        std::ios::out | std::ios::binary | std::ios::app);
-        if (!fs) {
-            std::cerr << "Error opening file: " << save_name << "\n";
+        auto& staging = manager.input_buffer;
+        auto flush = [&]() {
+            if (out_fd < 0) {
+                write_block(fs, staging.data(), staging.size());
+            } else {
+                good = write_block_at(out_fd, offset, staging.data(),
+                                      staging.size()) && good;
+                offset += staging.size() * sizeof(T);
+            }
+            staging.clear();
+        };
+        auto stage = [&](const T& key) {
+            staging.push_back(key);
+            if (staging.size() == staging.capacity()) flush();
+        };
+        if (!manager.middle_group.empty()) {
+            T smallest = manager.middle_group.findMin();
+            T largest = manager.middle_group.findMax();
+            for (; equal_min; --equal_min) stage(smallest);
+            while (!manager.middle_group.empty())
+                stage(manager.middle_group.popMin());  // ascending
+            for (; equal_max; --equal_max) stage(largest);
         }
-        while (!manager.small_group.empty()) {
-            T data_to_save = manager.small_group.back();
-            manager.small_group.pop_back();
-            fs.write(reinterpret_cast<char*>(&data_to_save), sizeof(T));
-            disk_write_count++;
+        if (!staging.empty()) flush();
+        if (out_fd < 0) {
+            fs.close();
+            good = good && !fs.fail();
         }
-        fs.close();
     }
 
 #ifdef DEBUG
@@ -278,19 +441,397 @@ void ext_qsort(TreeNode<std::string>* cur_node) {
 #endif
 
     /* done */
+    std::lock_guard<std::mutex> guard(log_mutex);
+    PRINT_SEPARATOR_START;
     std::cout << "Read " << input_name << " done!" << std::endl;
     PRINT_TIME_SO_FAR;
     PRINT_SEPARATOR_END;
 
-    /* recursively process large and small groups */
-    if (cur_node->RightChild) {
-        ext_qsort<T>(cur_node->RightChild);
+    if (!good)
+        std::cerr << "Error writing the partitions of " << input_name << "\n";
+    return good;
+}
+
+/* partition_with() the middle group heap chosen by INTERVAL_HEAP */
+template <typename T>
+bool partition(TreeNode<std::string>* cur_node, unsigned long mem, int out_fd,
+               unsigned long long base,
+               std::pair<unsigned long long, unsigned long long>& dumped) {
+    if (INTERVAL_HEAP)
+        return partition_with<T, interval_heap_t<T>>(cur_node, mem, out_fd,
+                                                     base, dumped);
+    return partition_with<T, MinMaxHeap<T>>(cur_node, mem, out_fd, base,
+                                            dumped);
+}
+
+/* bytes in file name */
+unsigned long long file_size(const std::string& name) {
+    std::ifstream fs(name, std::ios::in | std::ios::binary | std::ios::ate);
+    return fs ? (unsigned long long)fs.tellg() : 0;
+}
+
+/**
+ * @brief Partitions root and then its descendants. Pending nodes wait on an
+ *        explicit stack; the smaller child of a pass is taken next, so the
+ *        stack holds at most log2 of the input size in nodes.
+ *
+ * With out_fd, every node carries the output offset where its subtree
+ * starts: the small child starts there too, and the large child right
+ * after the middle group. Each pass places its middle group at once, and
+ * the file of every node but root is deleted as soon as it is read.
+ *
+ * @return false, with the rest of the tree left unsorted, if a pass fails.
+ */
+template <typename T>
+bool ext_qsort(TreeNode<std::string>* root, int out_fd = -1) {
+    using pending_t = std::pair<TreeNode<std::string>*, unsigned long long>;
+    std::vector<pending_t> pending = {{root, 0}};
+    while (!pending.empty()) {
+        auto cur_node = pending.back().first;
+        auto base = pending.back().second;
+        pending.pop_back();
+        auto size = file_size(cur_node->data);
+        std::pair<unsigned long long, unsigned long long> dumped;
+        if (!partition<T>(cur_node, TOTAL_MEM, out_fd, base, dumped))
+            return false;
+        if (out_fd >= 0 && cur_node != root)
+            std::remove(cur_node->data.c_str());
+
+        pending_t smaller = {cur_node->LeftChild, base};
+        pending_t larger = {cur_node->RightChild, base + size - dumped.second};
+        if (dumped.first > dumped.second) std::swap(smaller, larger);
+        if (larger.first) pending.push_back(larger);
+        if (smaller.first) pending.push_back(smaller);
+    }
+    return true;
+}
+
+/* what the tasks of one ext_qsort_parallel() share */
+struct qsort_shared_t {
+    memory_budget_t budget;
+    TreeNode<std::string>* root;
+    int out_fd;  // see ext_qsort()
+    std::atomic<bool> failed{false};  // a pass failed, start no more
+};
+
+/**
+ * @brief Partitions cur_node, whose subtree starts at output offset base,
+ *        on worker and pushes its children back onto the pool, the smaller
+ *        one last so the worker takes it next.
+ *
+ * The pass runs on a slice of budget: at least an equal share of TOTAL_MEM
+ * among the workers, and up to TOTAL_MEM when other tasks leave room. With
+ * IN_MEMORY_LEAVES neither is more than the whole file, which is then
+ * sorted in memory; a pass to disk keeps its share however small the file,
+ * and never less than min_pass_mem().
+ */
+template <typename T>
+void qsort_task(TreeNode<std::string>* cur_node, unsigned long long base,
+                qsort_shared_t& shared, task_pool_t& pool, size_t worker) {
+    if (shared.failed) return;
+    auto size = file_size(cur_node->data);
+    unsigned long share =
+        std::max<unsigned long>(TOTAL_MEM / pool.size(), min_pass_mem<T>());
+    unsigned long long cap = IN_MEMORY_LEAVES ? size : TOTAL_MEM;
+    unsigned long least = std::min<unsigned long long>(cap, share);
+    unsigned long most = std::min<unsigned long long>(cap, TOTAL_MEM);
+    auto mem = shared.budget.acquire(least, most);
+    std::pair<unsigned long long, unsigned long long> dumped;
+    bool good = partition<T>(cur_node, mem, shared.out_fd, base, dumped);
+    shared.budget.release(mem);
+    if (!good) {
+        shared.failed = true;
+        return;
     }
-    if (cur_node->LeftChild) {
-        ext_qsort<T>(cur_node->LeftChild);
+    if (shared.out_fd >= 0 && cur_node != shared.root)
+        std::remove(cur_node->data.c_str());
+
+    using pending_t = std::pair<TreeNode<std::string>*, unsigned long long>;
+    pending_t smaller = {cur_node->LeftChild, base};
+    pending_t larger = {cur_node->RightChild, base + size - dumped.second};
+    if (dumped.first > dumped.second) std::swap(smaller, larger);
+    for (auto child : {larger, smaller}) {
+        if (!child.first) continue;
+        pool.push(
+            [child, &shared](task_pool_t& pool, size_t worker) {
+                qsort_task<T>(child.first, child.second, shared, pool,
+                              worker);
+            },
+            worker);
     }
 }
 
+/**
+ * @brief ext_qsort with THREADS workers: every TreeNode is a task of a
+ *        work-stealing pool, and the memory of the passes running at once
+ *        never adds up to more than TOTAL_MEM. With out_fd, partitions are
+ *        placed as in ext_qsort() and leaves finish in any order.
+ * @return false if a pass failed; the passes under way run to the end.
+ */
+template <typename T>
+bool ext_qsort_parallel(TreeNode<std::string>* root, int out_fd = -1) {
+    qsort_shared_t shared{memory_budget_t(TOTAL_MEM), root, out_fd};
+    task_pool_t pool(THREADS);
+    pool.push([root, &shared](task_pool_t& pool, size_t worker) {
+        qsort_task<T>(root, 0, shared, pool, worker);
+    });
+    pool.run();
+    std::cout << "Workers: " << pool.size() << ", steals: " << pool.steal_count
+              << ", peak memory: " << shared.budget.in_use_peak << std::endl;
+    return !shared.failed;
+}
+
+/* delete the partition files below cur_node, left by a failed sort */
+void remove_partitions(TreeNode<std::string>* cur_node) {
+    for (auto child : {cur_node->LeftChild, cur_node->RightChild}) {
+        if (!child) continue;
+        std::remove(child->data.c_str());
+        remove_partitions(child);
+    }
+}
+
+/* a file of the distribution sort and its size in bytes */
+struct bucket_t {
+    std::string name;
+    unsigned long long size;
+    unsigned long level;  // distribution passes above it
+    bool equal;           // every key the same, already in order
+};
+
+/**
+ * @brief ways - 1 splitters from a sample of the file: runs of SAMPLE_RUN
+ *        keys at jittered, evenly spaced offsets, DISTRIBUTION_OVERSAMPLE
+ *        keys per way, sorted and cut at every ways-th quantile. A key
+ *        that fills more than one quantile comes out repeated.
+ */
+template <typename T>
+std::vector<T> sample_splitters(std::ifstream& input, unsigned long long items,
+                                size_t ways) {
+    size_t runs = std::max<size_t>(
+        ways * DISTRIBUTION_OVERSAMPLE / SAMPLE_RUN, 1);
+    size_t run = std::min<unsigned long long>(SAMPLE_RUN, items);
+    unsigned long long stride = (items - run) / runs + 1;
+    std::mt19937_64 rng(items);
+
+    std::vector<T> sample, keys(run);
+    keys.reserve(run);
+    for (size_t r = 0; r < runs; ++r) {
+        unsigned long long pos = std::min(r * stride + rng() % stride,
+                                          items - run);
+        input.seekg(pos * sizeof(T), input.beg);
+        read_block(input, keys);
+        sample.insert(sample.end(), keys.begin(), keys.end());
+    }
+    input.clear();
+    input.seekg(0, input.beg);
+
+    std::sort(sample.begin(), sample.end());
+    std::vector<T> splitters(ways - 1);
+    for (size_t j = 0; j + 1 < ways; ++j)
+        splitters[j] = sample[(j + 1) * sample.size() / ways];
+    return splitters;
+}
+
+/**
+ * @brief One distribution pass over bucket with mem bytes: the splitter
+ *        tree routes every key to one of ways bucket files, named
+ *        stem + ".b<n>" with n from made, written in blocks of one buffer
+ *        each.
+ *
+ * A splitter s[j] that repeats leaves bucket j + 1, the keys in (s[j], s[j]],
+ * empty, so the keys equal to s[j] go there instead: an equality bucket,
+ * which needs no further pass. With at least 4 ways every pass then makes
+ * progress: two distinct splitters land in different buckets, and a sample
+ * of one key (a degenerate one) splits at that key, its median, into the
+ * keys below, equal to and above it.
+ *
+ * @return false, with the files of this pass removed, on an I/O error.
+ */
+template <typename T>
+bool distribute(const bucket_t& bucket, unsigned long mem,
+                const std::string& stem, unsigned long& made,
+                std::vector<bucket_t>& result) {
+    /* the input block and its bucket numbers, then one buffer per bucket */
+    unsigned long input_size =
+        mem * INPUT_BUFFER_PROPORTION / (sizeof(T) + sizeof(uint16_t));
+    input_size = std::max<unsigned long>(input_size, 1);
+    unsigned long buckets_mem = mem - input_size * (sizeof(T) + 2);
+    size_t ways = 4;
+    while (ways * 2 <= DISTRIBUTION_MAX_WAYS &&
+           ways * 2 * DISTRIBUTION_BLOCK <= buckets_mem)
+        ways *= 2;
+    size_t buffer_size =
+        std::max<unsigned long>(buckets_mem / ways / sizeof(T), 1);
+
+    std::ifstream input(bucket.name, std::ios::in | std::ios::binary);
+    if (!input.good()) {
+        std::cerr << "Unable to read file " << bucket.name << " !"
+                  << std::endl;
+        return false;
+    }
+    unsigned long long items = bucket.size / sizeof(T);
+    auto splitters = sample_splitters<T>(input, items, ways);
+    splitter_tree_t<T> tree(splitters);
+
+    /* equal[j]: keys equal to s[j] move on to equality bucket j + 1 */
+    std::vector<char> equal(ways, false);
+    for (size_t j = 0; j + 2 < ways; ++j)
+        equal[j] = splitters[j] == splitters[j + 1] &&
+                   (j == 0 || splitters[j - 1] != splitters[j]);
+
+    {
+        std::lock_guard<std::mutex> guard(log_mutex);
+        PRINT_SEPARATOR_START;
+        std::cout << "Distributing file " << bucket.name << " into " << ways
+                  << " buckets!" << std::endl;
+        std::cout << "Total size (in bytes): " << bucket.size << std::endl;
+        std::cout << "Total items: " << items << std::endl;
+        PRINT_SEPARATOR_END;
+    }
+
+    std::vector<T> block;
+    block.reserve(input_size);
+    std::vector<uint16_t> oracle(input_size);
+    std::vector<std::vector<T>> buffers(ways);
+    for (auto& buffer : buffers) buffer.reserve(buffer_size);
+    std::vector<std::ofstream> files(ways);
+    std::vector<bucket_t> buckets(ways);
+    for (size_t j = 0; j < ways; ++j)
+        buckets[j] = {"", 0, bucket.level + 1, j > 0 && equal[j - 1]};
+
+    /* files are created on their first block, so empty buckets make none;
+     * the pass stops at the first file that fails */
+    bool good = true;
+    auto flush = [&](size_t j) {
+        if (!files[j].is_open()) {
+            buckets[j].name =
+                stem + DUMPED_BUCKET_SUFFIX + std::to_string(made++);
+            files[j].open(buckets[j].name,
+                          std::ios::out | std::ios::binary | std::ios::trunc);
+        }
+        write_block(files[j], buffers[j].data(), buffers[j].size());
+        buckets[j].size += buffers[j].size() * sizeof(T);
+        buffers[j].clear();
+        if (!files[j]) {
+            std::cerr << "Error writing file: " << buckets[j].name << "\n";
+            good = false;
+        }
+    };
+
+    for (read_block(input, block); good && !block.empty();
+         read_block(input, block)) {
+        /* classify the whole block first, then scatter it */
+        tree.classify(block.data(), block.size(), oracle.data());
+        for (size_t e = 0; e < block.size(); ++e) {
+            size_t j = oracle[e];
+            if (equal[j] && block[e] == splitters[j]) ++j;
+            buffers[j].push_back(block[e]);
+            if (buffers[j].size() == buffer_size) flush(j);
+        }
+    }
+    for (size_t j = 0; good && j < ways; ++j)
+        if (!buffers[j].empty()) flush(j);
+
+    for (auto& file : files) {
+        if (!file.is_open()) continue;
+        file.close();
+        good = good && !file.fail();
+    }
+    for (auto& b : buckets) {
+        if (!b.size) continue;
+        if (good)
+            result.push_back(b);
+        else
+            std::remove(b.name.c_str());
+    }
+    return good;
+}
+
+/* append the file name to output in blocks of mem bytes */
+template <typename T>
+void append_file(const std::string& name, std::ofstream& output,
+                 unsigned long mem) {
+    std::ifstream input(name, std::ios::in | std::ios::binary);
+    std::vector<T> block;
+    block.reserve(std::max<unsigned long>(mem / sizeof(T), 1));
+    for (read_block(input, block); !block.empty(); read_block(input, block))
+        write_block(output, block.data(), block.size());
+}
+
+/**
+ * @brief Distribution sort of input_name into output_name: a file larger
+ *        than TOTAL_MEM is split into up to DISTRIBUTION_MAX_WAYS buckets
+ *        by sampled splitters, and every bucket is split again or, once it
+ *        fits, sorted in memory and appended to the output. Buckets are
+ *        taken in key order from a stack, so the output is written front
+ *        to back and every bucket file is deleted as soon as it is used.
+ *        Equality buckets (see distribute()) are copied through as they
+ *        are.
+ *
+ * @return false, with no output and no bucket files left, on an I/O error.
+ */
+template <typename T>
+bool ext_dist_sort(const std::string& input_name,
+                   const std::string& output_name) {
+    std::ofstream output(output_name,
+                         std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output) {
+        std::cerr << "Error opening file: " << output_name << "\n";
+        return false;
+    }
+
+    std::vector<bucket_t> pending = {
+        {input_name, file_size(input_name), 0, false}};
+    unsigned long levels = 0, made = 0;
+    auto done_with = [&](const bucket_t& bucket) {
+        if (bucket.level > 0) std::remove(bucket.name.c_str());
+    };
+    while (!pending.empty() && output) {
+        auto bucket = pending.back();
+        pending.pop_back();
+        levels = std::max(levels, bucket.level);
+
+        if (bucket.equal) {
+            append_file<T>(bucket.name, output, TOTAL_MEM);
+            done_with(bucket);
+            continue;
+        }
+
+        if (bucket.size <= TOTAL_MEM) {
+            std::vector<T> data;
+            data.reserve(bucket.size / sizeof(T));
+            {
+                std::ifstream fs(bucket.name, std::ios::in | std::ios::binary);
+                read_block(fs, data);
+            }
+            std::sort(data.begin(), data.end());
+            write_block(output, data.data(), data.size());
+            done_with(bucket);
+            continue;
+        }
+
+        std::vector<bucket_t> buckets;
+        bool good = distribute<T>(bucket, TOTAL_MEM, input_name, made,
+                                  buckets);
+        done_with(bucket);
+        if (!good) {
+            output.setstate(std::ios::failbit);
+            break;
+        }
+        pending.insert(pending.end(), buckets.rbegin(), buckets.rend());
+    }
+    output.close();
+    if (!pending.empty() || output.fail()) {
+        std::cerr << "Distribution sort failed, " << output_name
+                  << " removed.\n";
+        for (auto& bucket : pending) done_with(bucket);
+        std::remove(output_name.c_str());
+        return false;
+    }
+    std::cout << "Distribution levels: " << levels << std::endl;
+    return true;
+}
+
 void merge(std::string& output_name, TreeNode<std::string>* cur_node) {
     if (cur_node) {
         merge(output_name, cur_node->LeftChild);
@@ -308,16 +849,44 @@ void merge(std::string& output_name, TreeNode<std::string>* cur_node) {
 }
 
 int main(int argc, char* argv[]) {
-    /*
-    if (argc < 4) {
-        std::cout << "Usage: input_file output_file mem_size" << std::endl;
-        return 0;
-    }
+    std::string input_name = "data_chunk_1KB";
+    std::string output_name = "data_chunk_1KB_sorted";
+    TOTAL_MEM = 1024*32;
 
-    std::string input_name = argv[1];
-    std::string output_name = argv[2];
-    TOTAL_MEM = strtol(argv[3], nullptr, 0); // available memory in bytes
-    */
+    /* Usage: input_file output_file mem_size [--disk-leaves] [--threads=N]
+              [--distribute] [--no-equal-range] [--direct]
+              [--minmax-heap] */
+    if (argc >= 4) {
+        input_name = argv[1];
+        output_name = argv[2];
+        TOTAL_MEM = strtol(argv[3], nullptr, 0);  // available memory in bytes
+    }
+    for (int n = 4; n < argc; ++n) {
+        std::string option = argv[n];
+        if (option == "--disk-leaves")
+            IN_MEMORY_LEAVES = false;
+        else if (option.compare(0, 10, "--threads=") == 0)
+            THREADS = std::max(strtoul(option.c_str() + 10, nullptr, 0), 1ul);
+        else if (option == "--distribute")
+            DISTRIBUTE = true;
+        else if (option == "--no-equal-range")
+            EQUAL_RANGE = false;
+        else if (option == "--direct")
+            DIRECT_PLACEMENT = true;
+        else if (option == "--minmax-heap")
+            INTERVAL_HEAP = false;
+        else
+            std::cerr << "Unknown option " << option << "\n";
+    }
+    if (DISTRIBUTE && DIRECT_PLACEMENT) {
+        std::cerr << "--direct does not apply to --distribute.\n";
+        return -1;
+    }
+    if (TOTAL_MEM < min_pass_mem<uint32_t>()) {
+        std::cerr << "Memory must be at least " << min_pass_mem<uint32_t>()
+                  << " bytes.\n";
+        return -1;
+    }
 
 #ifdef DEBUG
     /* test endianness of the platform */
@@ -333,20 +902,49 @@ int main(int argc, char* argv[]) {
     }
 #endif
 
-    std::string input_name = "data_chunk_1KB";
-    std::string output_name = "data_chunk_1KB_sorted";
-    TOTAL_MEM = 1024*32;
-
     disk_read_count = disk_write_count = 0;
 
-    auto* root_node = new TreeNode<std::string>(input_name);
-
-    ext_qsort<uint32_t>(root_node);
-    merge(output_name, root_node);
+    if (DISTRIBUTE) {
+        if (!ext_dist_sort<uint32_t>(input_name, output_name)) return -1;
+    } else if (DIRECT_PLACEMENT) {
+        /* the output is allocated up front and filled in place, no merge */
+        auto size = file_size(input_name);
+        int fd = ::open(output_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                        0644);
+        if (fd < 0 || (posix_fallocate(fd, 0, size) != 0 &&
+                       ftruncate(fd, size) != 0)) {
+            std::cerr << "Error opening file: " << output_name << "\n";
+            return -1;
+        }
+        auto* root_node = new TreeNode<std::string>(input_name);
+
+        bool good = THREADS > 1 ? ext_qsort_parallel<uint32_t>(root_node, fd)
+                                : ext_qsort<uint32_t>(root_node, fd);
+        good = close(fd) == 0 && good;
+        if (!good) {
+            std::cerr << "Sort failed, " << output_name << " removed.\n";
+            remove_partitions(root_node);
+            std::remove(output_name.c_str());
+            return -1;
+        }
+    } else {
+        auto* root_node = new TreeNode<std::string>(input_name);
+
+        bool good = THREADS > 1 ? ext_qsort_parallel<uint32_t>(root_node)
+                                : ext_qsort<uint32_t>(root_node);
+        if (!good) {
+            std::cerr << "Sort failed, " << output_name << " not written.\n";
+            remove_partitions(root_node);
+            return -1;
+        }
+        merge(output_name, root_node);
+    }
 
     std::cout << "Finished.\n";
-    std::cout << "Disk read count: " << disk_read_count << std::endl;
-    std::cout << "Disk write count: " << disk_write_count << std::endl;
+    std::cout << "Disk read count: " << disk_read_count << " ("
+              << disk_read_bytes << " bytes)" << std::endl;
+    std::cout << "Disk write count: " << disk_write_count << " ("
+              << disk_write_bytes << " bytes)" << std::endl;
     PRINT_TIME_SO_FAR;
     return 0;
 }
\ No newline at end of file
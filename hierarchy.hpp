@@ -0,0 +1,227 @@
+/**
+ * @file hierarchy.hpp
+ * @author HUANG Qiyue
+ * @brief Multi-level cache hierarchy in front of the matrix files.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * Levels only track which lines they hold; no values are cached. An access
+ * probes L1, L2, ... in turn, paying each level's latency, until a level
+ * hits or memory is reached. The line is then filled into the levels above
+ * the one that had it.
+ *
+ * A level below L1 is either
+ *     INCLUSIVE  holds everything the levels above hold: it is filled on
+ *                the way up and its evictions are invalidated above, or
+ *     EXCLUSIVE  holds nothing the level above holds: a hit moves the line
+ *                up, and the victims of the level above move down into it.
+ * Line sizes must grow downwards by whole multiples, and an EXCLUSIVE level
+ * must use the line size of the level above.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cache_engines.hpp"
+
+enum inclusion_t { INCLUSIVE, EXCLUSIVE };
+
+struct level_config_t {
+    size_t capacity;        // in lines
+    size_t line_size;       // elements per line
+    std::string policy;     // LRU or CLOCK
+    inclusion_t inclusion;  // towards the level above, ignored for L1
+    double latency;         // cost of a lookup at this level
+};
+
+/**
+ * @brief The engine of one level, behind a virtual interface so that the
+ *        levels of a hierarchy can run different policies.
+ */
+class level_cache_t {
+   public:
+    virtual ~level_cache_t() = default;
+    virtual bool find(size_t line) = 0;
+    virtual size_t insert(size_t line) = 0;  // evicted line or CACHE_NPOS
+    virtual bool erase(size_t line) = 0;
+    virtual void clear() = 0;
+};
+
+template <class Cache>
+class level_engine_t : public level_cache_t {
+   public:
+    explicit level_engine_t(size_t capacity) : cache(capacity) {}
+    bool find(size_t line) override {
+        return cache.find(line) != CACHE_NPOS;
+    }
+    size_t insert(size_t line) override {
+        size_t victim;
+        cache.insert(line, victim);
+        return victim;
+    }
+    bool erase(size_t line) override { return cache.erase(line); }
+    void clear() override { cache.clear(); }
+
+   private:
+    Cache cache;
+};
+
+/* levels need erase(), which LRU and CLOCK provide */
+inline std::unique_ptr<level_cache_t> make_level_cache(
+    const std::string& policy, size_t capacity) {
+    if (policy == "CLOCK")
+        return std::unique_ptr<level_cache_t>(
+            new level_engine_t<clock_cache_t>(capacity));
+    if (policy != "LRU")
+        std::cerr << "Unsupported level policy " << policy << ", using LRU\n";
+    return std::unique_ptr<level_cache_t>(
+        new level_engine_t<flat_lru_t>(capacity));
+}
+
+class cache_hierarchy_t {
+   public:
+    cache_hierarchy_t(std::vector<level_config_t> _levels,
+                      double _memory_latency)
+        : levels(std::move(_levels)), memory_latency(_memory_latency) {
+        for (size_t l = 0; l < levels.size(); ++l) {
+            auto& level = levels[l];
+            caches.push_back(make_level_cache(level.policy, level.capacity));
+            if (l == 0) continue;
+            auto& above = levels[l - 1];
+            if (level.line_size % above.line_size != 0) {
+                std::cerr << "L" << l + 1 << " line size is not a multiple "
+                          << "of L" << l << ", using L" << l << "'s.\n";
+                level.line_size = above.line_size;
+            }
+            if (level.inclusion == EXCLUSIVE &&
+                level.line_size != above.line_size) {
+                std::cerr << "Exclusive L" << l + 1 << " needs the line size "
+                          << "of L" << l << ", made inclusive.\n";
+                level.inclusion = INCLUSIVE;
+            }
+        }
+        reset_counters();
+    }
+
+    /* one read or write of element addr */
+    void access(size_t addr) {
+        access_count++;
+        size_t hit = levels.size();  // level that had the line
+        for (size_t l = 0; l < levels.size(); ++l) {
+            total_cost += levels[l].latency;
+            if (caches[l]->find(addr / levels[l].line_size)) {
+                hit_count[l]++;
+                hit = l;
+                break;
+            }
+            miss_count[l]++;
+        }
+        if (hit == levels.size()) total_cost += memory_latency;
+
+        /* the line moves up out of an exclusive level */
+        if (hit > 0 && hit < levels.size() && exclusive(hit))
+            caches[hit]->erase(addr / levels[hit].line_size);
+        for (size_t l = hit; l-- > 0;) {
+            if (l == 0 || !exclusive(l)) fill(l, addr / levels[l].line_size);
+        }
+    }
+
+    /* average cost of an access */
+    double amat() const { return access_count ? total_cost / access_count : 0; }
+
+    void reset_counters() {
+        hit_count.assign(levels.size(), 0);
+        miss_count.assign(levels.size(), 0);
+        access_count = 0;
+        total_cost = 0;
+    }
+
+    /* empty every level */
+    void clear() {
+        for (auto& cache : caches) cache->clear();
+    }
+
+    std::vector<level_config_t> levels;
+    double memory_latency;
+
+    /* stat */
+    std::vector<uint64_t> hit_count;   // per level
+    std::vector<uint64_t> miss_count;  // per level, lookups passed down
+    uint64_t access_count;
+    double total_cost;
+
+   private:
+    bool exclusive(size_t l) const {
+        return l > 0 && levels[l].inclusion == EXCLUSIVE;
+    }
+
+    /* put a non-resident line into level l and place its victim */
+    void fill(size_t l, size_t line) {
+        auto victim = caches[l]->insert(line);
+        if (victim == CACHE_NPOS) return;
+        if (l > 0 && !exclusive(l)) invalidate_above(l, victim);
+        if (l + 1 < levels.size() && exclusive(l + 1) &&
+            !caches[l + 1]->find(victim))
+            fill(l + 1, victim);
+    }
+
+    /* an inclusive level lost line: so do the levels above it */
+    void invalidate_above(size_t l, size_t line) {
+        for (size_t u = l; u-- > 0;) {
+            size_t ratio = levels[l].line_size / levels[u].line_size;
+            for (size_t sub = line * ratio; sub < (line + 1) * ratio; ++sub)
+                caches[u]->erase(sub);
+        }
+    }
+
+    std::vector<std::unique_ptr<level_cache_t>> caches;
+};
+
+/**
+ * @brief Stands in for a buffer_t in the LOOP macro: every access goes to
+ *        a hierarchy at element base + i * col + j, and reads return T().
+ *        Several matrices can share one hierarchy at different bases.
+ */
+template <class T>
+class hierarchy_matrix_t {
+   private:
+    struct vector_t;
+
+   public:
+    hierarchy_matrix_t(cache_hierarchy_t& _hierarchy, size_t _base,
+                       size_t _col)
+        : hierarchy(_hierarchy), base(_base), col(_col) {}
+
+    vector_t operator[](size_t i) { return vector_t(i, this); }
+
+    void assign(size_t i, size_t j, T /* val */) {
+        hierarchy.access(base + i * col + j);
+    }
+
+    cache_hierarchy_t& hierarchy;
+    size_t base;
+    size_t col;
+
+   private:
+    /* proxy class */
+    struct vector_t {
+        size_t i;
+        hierarchy_matrix_t<T>* parent;
+        vector_t(size_t _i, hierarchy_matrix_t<T>* e) : i(_i), parent(e) {}
+
+        const T operator[](size_t j) const {
+            parent->hierarchy.access(parent->base + i * parent->col + j);
+            return T();
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,389 @@
+/**
+ * @file ooc_gemm.cpp
+ * @author HUANG Qiyue
+ * @brief Out-of-core blocked matrix multiply c = a * b over matrix files.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * The files use the matrix_t format of simulator.cpp with uint32_t
+ * elements, row-major. c is divided into T x T tiles; each tile of c is
+ * accumulated in memory from the tiles of a's row band and b's column
+ * band, then written once. While one pair of a and b tiles is multiplied
+ * the next pair is read on another thread (double buffering), so five
+ * tiles are resident at a time and T is the largest multiple of
+ * KERNEL_COLS that fits the memory budget. A budget without room for
+ * KERNEL_COLS x KERNEL_COLS tiles is refused.
+ *
+ * An operand written by ooc_transpose is read tile by tile from its
+ * transposed payload and turned back in memory, which takes one more tile.
+ * With b transposed, the b tiles of a column band are contiguous.
+ *
+ * Arithmetic wraps modulo 2^32, as in the simulator. A multiply-add counts
+ * as two operations in the reported GOP/s.
+ *
+ * Build with AVX2 for the vector kernel:
+ *     g++ -std=c++17 -O2 -mavx2 -pthread ooc_gemm.cpp -o ooc_gemm
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#define FINAL_CHECK
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "defs.h"
+#include "storage.hpp"
+#include "structures.hpp"
+#include "transpose.hpp"
+
+/* micro-kernel block of c kept in registers */
+const size_t KERNEL_ROWS = 4;
+const size_t KERNEL_COLS = 16;  // two vectors of 8
+
+/* file I/O, counted */
+uint64_t bytes_read = 0;
+uint64_t bytes_written = 0;
+uint64_t read_ops = 0;
+uint64_t write_ops = 0;
+
+/* header of a matrix file, false if it is not a row-major uint32_t one;
+   a transposed copy (see transpose.hpp) is accepted */
+bool read_header(storage_t& file, matrix_t<uint32_t>& header,
+                 const char* filename) {
+    header = {};
+    if (!file.good()) {
+        std::cerr << "Error opening file: " << filename << "\n";
+        return false;
+    }
+    file.read(0, &header, MATRIX_ARR_OFFSET);
+    if (!header.header_ok() || header.size_of_T != sizeof(uint32_t) ||
+        (header.layout & ~LAYOUT_TRANSPOSED) != LAYOUT_ROW_MAJOR) {
+        std::cerr << filename << " is not a row-major uint32_t matrix.\n";
+        return false;
+    }
+    if (file.size() < MATRIX_ARR_OFFSET + header.payload_size()) {
+        std::cerr << filename << " is shorter than its header says.\n";
+        return false;
+    }
+    return true;
+}
+
+/* a random row x col matrix file, written one row at a time */
+void generate_file(const char* filename, uint32_t row, uint32_t col) {
+    std::fstream fs(filename, std::ios::out | std::ios::binary);
+    uint32_t header[MATRIX_METADATA] = {MAGIC, row, col, sizeof(uint32_t),
+                                        LAYOUT_ROW_MAJOR, MATRIX_ARR_OFFSET};
+    fs.write(reinterpret_cast<char*>(header), sizeof(header));
+    std::mt19937 rng(std::random_device{}());
+    std::vector<uint32_t> line(col);
+    for (uint32_t i = 0; i < row; ++i) {
+        std::generate(line.begin(), line.end(), rng);
+        fs.write(reinterpret_cast<char*>(line.data()),
+                 line.size() * sizeof(uint32_t));
+    }
+}
+
+/* reads the rows x cols block at (row0, col0) of a stored payload that is
+   stored_col wide into tile, one read per row */
+void read_block(storage_t& file, size_t stored_col, size_t row0, size_t col0,
+                size_t rows, size_t cols, matrix_t<uint32_t>& tile) {
+    for (size_t r = 0; r < rows; ++r) {
+        size_t offset = (row0 + r) * stored_col + col0;
+        file.read(MATRIX_ARR_OFFSET + offset * sizeof(uint32_t), tile[r],
+                  cols * sizeof(uint32_t));
+    }
+    bytes_read += rows * cols * sizeof(uint32_t);
+    read_ops += rows;
+}
+
+/**
+ * @brief Loads the T x T tile of file at tile coordinates (ti, tj); parts
+ *        outside the matrix are zero. A transposed file is read through
+ *        scratch, a tile of the same size.
+ */
+void load_tile(storage_t& file, const matrix_t<uint32_t>& header,
+               size_t ti, size_t tj, matrix_t<uint32_t>& tile,
+               matrix_t<uint32_t>& scratch) {
+    size_t T = tile.row;
+    size_t row0 = ti * T, col0 = tj * T;
+    size_t rows = std::min(T, header.row - row0);
+    size_t cols = std::min(T, header.col - col0);
+    if (header.layout & LAYOUT_TRANSPOSED) {
+        read_block(file, header.row, col0, row0, cols, rows, scratch);
+        transpose_block(scratch[0], T, tile[0], T, cols, rows);
+    } else {
+        read_block(file, header.col, row0, col0, rows, cols, tile);
+    }
+    for (size_t r = 0; r < T; ++r)
+        std::fill(tile[r] + (r < rows ? cols : 0), tile[r] + T, 0);
+}
+
+/* writes the part of tile (ti, tj) inside the matrix, one write per row */
+void store_tile(storage_t& file, const matrix_t<uint32_t>& header,
+                size_t ti, size_t tj, matrix_t<uint32_t>& tile) {
+    size_t T = tile.row;
+    size_t row0 = ti * T, col0 = tj * T;
+    size_t rows = std::min(T, header.row - row0);
+    size_t cols = std::min(T, header.col - col0);
+    for (size_t r = 0; r < rows; ++r) {
+        size_t offset = (row0 + r) * header.col + col0;
+        file.write(MATRIX_ARR_OFFSET + offset * sizeof(uint32_t), tile[r],
+                   cols * sizeof(uint32_t));
+        bytes_written += cols * sizeof(uint32_t);
+        write_ops++;
+    }
+}
+
+/**
+ * @brief c += a * b on T x T tiles, T a multiple of KERNEL_COLS. Each
+ *        KERNEL_ROWS x KERNEL_COLS block of c stays in registers for the
+ *        whole k loop.
+ */
+void multiply_tile(const matrix_t<uint32_t>& a, const matrix_t<uint32_t>& b,
+                   matrix_t<uint32_t>& c) {
+    size_t T = a.row;
+    /* j outermost: the T x KERNEL_COLS panel of b stays in cache for all i */
+    for (size_t j = 0; j < T; j += KERNEL_COLS) {
+        for (size_t i = 0; i < T; i += KERNEL_ROWS) {
+#ifdef __AVX2__
+            __m256i acc[KERNEL_ROWS][2];
+            for (size_t r = 0; r < KERNEL_ROWS; ++r) {
+                auto row = reinterpret_cast<__m256i*>(c[i + r] + j);
+                acc[r][0] = _mm256_load_si256(row);
+                acc[r][1] = _mm256_load_si256(row + 1);
+            }
+            for (size_t k = 0; k < T; ++k) {
+                auto bk = reinterpret_cast<const __m256i*>(b[k] + j);
+                __m256i b0 = _mm256_load_si256(bk);
+                __m256i b1 = _mm256_load_si256(bk + 1);
+                for (size_t r = 0; r < KERNEL_ROWS; ++r) {
+                    __m256i aik = _mm256_set1_epi32(a[i + r][k]);
+                    acc[r][0] = _mm256_add_epi32(
+                        acc[r][0], _mm256_mullo_epi32(aik, b0));
+                    acc[r][1] = _mm256_add_epi32(
+                        acc[r][1], _mm256_mullo_epi32(aik, b1));
+                }
+            }
+            for (size_t r = 0; r < KERNEL_ROWS; ++r) {
+                auto row = reinterpret_cast<__m256i*>(c[i + r] + j);
+                _mm256_store_si256(row, acc[r][0]);
+                _mm256_store_si256(row + 1, acc[r][1]);
+            }
+#else
+            uint32_t acc[KERNEL_ROWS][KERNEL_COLS];
+            for (size_t r = 0; r < KERNEL_ROWS; ++r)
+                std::copy(c[i + r] + j, c[i + r] + j + KERNEL_COLS, acc[r]);
+            for (size_t k = 0; k < T; ++k) {
+                const uint32_t* bk = b[k] + j;
+                for (size_t r = 0; r < KERNEL_ROWS; ++r) {
+                    uint32_t aik = a[i + r][k];
+                    for (size_t jj = 0; jj < KERNEL_COLS; ++jj)
+                        acc[r][jj] += aik * bk[jj];
+                }
+            }
+            for (size_t r = 0; r < KERNEL_ROWS; ++r)
+                std::copy(acc[r], acc[r] + KERNEL_COLS, c[i + r] + j);
+#endif
+        }
+    }
+}
+
+/* a square T x T tile, zeroed; arr is nullptr if it cannot be had */
+matrix_t<uint32_t> make_tile(size_t T) {
+    matrix_t<uint32_t> tile = {MAGIC, uint32_t(T), uint32_t(T),
+                               sizeof(uint32_t), LAYOUT_ROW_MAJOR,
+                               MATRIX_ARR_OFFSET, nullptr};
+    if (tile.allocate()) std::fill(tile[0], tile[T], 0);
+    return tile;
+}
+
+/* least mem for tiles tiles, each KERNEL_COLS x KERNEL_COLS */
+size_t min_tile_mem(size_t tiles) {
+    return tiles * KERNEL_COLS * KERNEL_COLS * sizeof(uint32_t);
+}
+
+/* largest tile side that keeps tiles tiles within mem bytes, at least
+ * KERNEL_COLS if mem is at least min_tile_mem(tiles) */
+size_t tile_side(size_t mem, size_t tiles) {
+    size_t T = std::sqrt(mem / (1.0 * tiles * sizeof(uint32_t)));
+    return T / KERNEL_COLS * KERNEL_COLS;
+}
+
+/**
+ * @brief c = a * b with at most mem bytes of tiles in memory.
+ * @return false if an input is unusable or mem holds no tiles.
+ */
+bool ooc_gemm(const char* a_name, const char* b_name, const char* c_name,
+              size_t mem) {
+    auto fa = open_storage(a_name, STORAGE_FSTREAM, false);
+    auto fb = open_storage(b_name, STORAGE_FSTREAM, false);
+    matrix_t<uint32_t> ha, hb;
+    if (!read_header(*fa, ha, a_name) || !read_header(*fb, hb, b_name))
+        return false;
+    if (ha.col != hb.row) {
+        std::cerr << "Inner dimensions differ: " << ha.col << " and "
+                  << hb.row << "\n";
+        return false;
+    }
+    bool transposed = (ha.layout | hb.layout) & LAYOUT_TRANSPOSED;
+    size_t tiles = transposed ? 6 : 5;
+    if (mem < min_tile_mem(tiles)) {
+        std::cerr << "Memory must be at least " << min_tile_mem(tiles)
+                  << " bytes.\n";
+        return false;
+    }
+
+    /* create c with its header, the payload is filled tile by tile */
+    matrix_t<uint32_t> hc = {MAGIC, ha.row, hb.col, sizeof(uint32_t),
+                             LAYOUT_ROW_MAJOR, MATRIX_ARR_OFFSET, nullptr};
+    {
+        std::fstream fs(c_name, std::ios::out | std::ios::binary);
+        fs.write(reinterpret_cast<char*>(&hc), MATRIX_ARR_OFFSET);
+    }
+    auto fc = open_storage(c_name, STORAGE_FSTREAM);
+
+    size_t T = tile_side(mem, tiles);
+    size_t tiles_i = (ha.row + T - 1) / T;
+    size_t tiles_j = (hb.col + T - 1) / T;
+    size_t tiles_k = (ha.col + T - 1) / T;
+    printf("a: %ux%u%s, b: %ux%u%s, Memory: %zu bytes, Tile: %zux%zu\n",
+           ha.row, ha.col, ha.layout & LAYOUT_TRANSPOSED ? " (T)" : "",
+           hb.row, hb.col, hb.layout & LAYOUT_TRANSPOSED ? " (T)" : "", mem,
+           T, T);
+
+    matrix_t<uint32_t> ta[2] = {make_tile(T), make_tile(T)};
+    matrix_t<uint32_t> tb[2] = {make_tile(T), make_tile(T)};
+    matrix_t<uint32_t> tc = make_tile(T);
+    matrix_t<uint32_t> scratch = make_tile(transposed ? T : 0);
+    for (auto& tile : {ta[0], ta[1], tb[0], tb[1], tc, scratch}) {
+        if (tile.arr) continue;
+        std::cerr << "Out of memory for " << T << " x " << T << " tiles.\n";
+        for (auto& other : {ta[0], ta[1], tb[0], tb[1], tc, scratch})
+            std::free(other.arr);
+        return false;
+    }
+
+    /* steps run (ti, tj, tk) with tk fastest */
+    size_t steps = tiles_i * tiles_j * tiles_k;
+    auto load_step = [&](size_t step, size_t buf) {
+        size_t tk = step % tiles_k, tj = step / tiles_k % tiles_j,
+               ti = step / tiles_k / tiles_j;
+        load_tile(*fa, ha, ti, tk, ta[buf], scratch);
+        load_tile(*fb, hb, tk, tj, tb[buf], scratch);
+    };
+
+    using gemm_clock = std::chrono::steady_clock;
+    auto start = gemm_clock::now();
+    std::chrono::duration<double> io_wait(0);
+
+    load_step(0, 0);
+    for (size_t step = 0; step < steps; ++step) {
+        size_t buf = step % 2;
+        std::future<void> next;
+        if (step + 1 < steps)
+            next = std::async(std::launch::async, load_step, step + 1, 1 - buf);
+
+        multiply_tile(ta[buf], tb[buf], tc);
+
+        size_t tk = step % tiles_k;
+        if (tk + 1 == tiles_k) {
+            size_t tj = step / tiles_k % tiles_j, ti = step / tiles_k / tiles_j;
+            store_tile(*fc, hc, ti, tj, tc);
+            std::fill(tc[0], tc[T], 0);
+        }
+
+        auto wait_start = gemm_clock::now();
+        if (next.valid()) next.get();
+        io_wait += gemm_clock::now() - wait_start;
+    }
+    std::chrono::duration<double> elapsed = gemm_clock::now() - start;
+
+    double ops = 2.0 * ha.row * hb.col * ha.col;
+    printf("Elapsed: %.3f s, I/O wait: %.3f s, %.3f GOP/s\n",
+           elapsed.count(), io_wait.count(), ops / elapsed.count() / 1e9);
+    printf("Bytes Read: %" PRIu64 " in %" PRIu64 " reads, Bytes Written: %"
+           PRIu64 " in %" PRIu64 " writes\n",
+           bytes_read, read_ops, bytes_written, write_ops);
+
+    for (auto& tile : {ta[0], ta[1], tb[0], tb[1], tc, scratch})
+        std::free(tile.arr);
+    if (!fa->good() || !fb->good() || !fc->good()) {
+        std::cerr << "I/O error, " << c_name << " is incomplete.\n";
+        return false;
+    }
+    return true;
+}
+
+/* recomputes samples entries of c from a and b */
+bool spot_check(const char* a_name, const char* b_name, const char* c_name,
+                size_t samples) {
+    auto fa = open_storage(a_name, STORAGE_FSTREAM, false);
+    auto fb = open_storage(b_name, STORAGE_FSTREAM, false);
+    auto fc = open_storage(c_name, STORAGE_FSTREAM, false);
+    matrix_t<uint32_t> ha, hb;
+    read_header(*fa, ha, a_name);
+    read_header(*fb, hb, b_name);
+
+    /* element (i, j) of a file, wherever its layout puts it */
+    auto element = [](storage_t& file, const matrix_t<uint32_t>& h, size_t i,
+                      size_t j) {
+        uint32_t v;
+        size_t index = layout_index(h.layout, h.row, h.col, i, j);
+        file.read(MATRIX_ARR_OFFSET + index * sizeof(uint32_t), &v,
+                  sizeof(v));
+        return v;
+    };
+
+    std::mt19937 rng(42);
+    for (size_t n = 0; n < samples; ++n) {
+        size_t i = rng() % ha.row, j = rng() % hb.col;
+        uint32_t expected = 0;
+        for (size_t k = 0; k < ha.col; ++k)
+            expected += element(*fa, ha, i, k) * element(*fb, hb, k, j);
+        uint32_t got;
+        fc->read(MATRIX_ARR_OFFSET + (i * hb.col + j) * sizeof(uint32_t),
+                 &got, sizeof(got));
+        if (got != expected) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cout << "Usage: a_file b_file c_file mem_size [N]\n"
+                  << "  with N, a and b are first generated as N x N\n";
+        return 0;
+    }
+    const char* a_name = argv[1];
+    const char* b_name = argv[2];
+    const char* c_name = argv[3];
+    size_t mem = strtoull(argv[4], nullptr, 0);  // tile memory in bytes
+
+    if (argc > 5) {
+        uint32_t N = strtoul(argv[5], nullptr, 0);
+        generate_file(a_name, N, N);
+        generate_file(b_name, N, N);
+    }
+
+    if (!ooc_gemm(a_name, b_name, c_name, mem)) return 1;
+
+#ifdef FINAL_CHECK
+    std::cout << c_name << " correct? " << std::boolalpha
+              << spot_check(a_name, b_name, c_name, 16) << std::endl;
+#endif
+    return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file ooc_transpose.cpp
+ * @author HUANG Qiyue
+ * @brief Writes the transposed copy of a matrix file, see transpose.hpp.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * Build:
+ *     g++ -std=c++17 -O2 ooc_transpose.cpp -o ooc_transpose
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+
+#include "transpose.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cout << "Usage: input_file output_file mem_size\n";
+        return 0;
+    }
+    size_t mem = strtoull(argv[3], nullptr, 0);  // tile memory in bytes
+
+    transpose_stat_t stat;
+    auto start = std::chrono::steady_clock::now();
+    if (!transpose_file(argv[1], argv[2], mem, stat)) return 1;
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    printf("Tile: %zux%zu, Elapsed: %.3f s, %.1f MB/s\n", stat.tile,
+           stat.tile, elapsed.count(),
+           stat.bytes_read / elapsed.count() / 1e6);
+    printf("Bytes Read: %" PRIu64 " in %" PRIu64 " reads, Bytes Written: %"
+           PRIu64 " in %" PRIu64 " writes\n",
+           stat.bytes_read, stat.read_ops, stat.bytes_written,
+           stat.write_ops);
+    return 0;
+}
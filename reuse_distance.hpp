@@ -0,0 +1,126 @@
+/**
+ * @file reuse_distance.hpp
+ * @author HUANG Qiyue
+ * @brief One-pass LRU stack-distance analysis.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * The stack distance of an access is the number of distinct keys touched
+ * since the previous access to the same key. An LRU cache of capacity C
+ * hits exactly the accesses with distance < C, so one histogram of
+ * distances gives the miss ratio of every capacity at once.
+ *
+ * Distances are counted with a Fenwick tree over access times in which only
+ * the latest access of each key is marked: O(log n) per access.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef REUSE_DISTANCE_H
+#define REUSE_DISTANCE_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class reuse_distance_t {
+   public:
+    reuse_distance_t() { clear(); }
+
+    /**
+     * @brief Pushes key to the top of the LRU stack. Only counted accesses
+     *        enter the histogram; uncounted ones (e.g. writes when the miss
+     *        ratio of reads is wanted) still reorder the stack.
+     */
+    void access(size_t key, bool counted = true) {
+        if (now == tree.size() - 1) compact();
+        auto it = last.find(key);
+        if (it == last.end()) {
+            if (counted) cold++;
+            last[key] = now;
+        } else {
+            if (counted) {
+                size_t distance = prefix(now - 1) - prefix(it->second);
+                if (distance >= histogram.size())
+                    histogram.resize(distance + 1, 0);
+                histogram[distance]++;
+            }
+            update(it->second, -1);
+            it->second = now;
+        }
+        update(now, +1);
+        if (counted) total++;
+        now++;
+    }
+
+    /* miss ratio of an LRU cache holding capacity keys */
+    double miss_ratio(size_t capacity) const {
+        if (total == 0) return 0;
+        uint64_t hits = 0;
+        for (size_t d = 0; d < std::min(capacity, histogram.size()); ++d)
+            hits += histogram[d];
+        return 1.0 * (total - hits) / total;
+    }
+
+    /* (capacity, miss ratio) at capacity 0 and wherever the ratio drops */
+    std::vector<std::pair<size_t, double>> curve() const {
+        std::vector<std::pair<size_t, double>> points = {{0, 1.0}};
+        uint64_t hits = 0;
+        for (size_t d = 0; d < histogram.size(); ++d) {
+            if (!histogram[d]) continue;
+            hits += histogram[d];
+            points.push_back({d + 1, 1.0 * (total - hits) / total});
+        }
+        return points;
+    }
+
+    void clear() {
+        tree.assign(1024 + 1, 0);
+        last.clear();
+        histogram.clear();
+        now = 0;
+        cold = total = 0;
+    }
+
+    std::vector<uint64_t> histogram;  // histogram[d]: accesses at distance d
+    uint64_t cold;                    // first accesses, infinite distance
+    uint64_t total;                   // counted accesses
+
+   private:
+    /* marks in [0, t] */
+    int64_t prefix(size_t t) const {
+        int64_t sum = 0;
+        for (size_t i = t + 1; i > 0; i -= i & (~i + 1)) sum += tree[i];
+        return sum;
+    }
+
+    void update(size_t t, int64_t delta) {
+        for (size_t i = t + 1; i < tree.size(); i += i & (~i + 1))
+            tree[i] += delta;
+    }
+
+    /* renumber live keys 0..k-1 by recency and rebuild a larger tree */
+    void compact() {
+        std::vector<std::pair<size_t, size_t>> order;  // (time, key)
+        order.reserve(last.size());
+        for (auto& kv : last) order.push_back({kv.second, kv.first});
+        std::sort(order.begin(), order.end());
+
+        tree.assign(std::max<size_t>(1024, 2 * order.size()) + 1, 0);
+        for (size_t t = 0; t < order.size(); ++t) {
+            last[order[t].second] = t;
+            update(t, +1);
+        }
+        now = order.size();
+    }
+
+    std::vector<int64_t> tree;  // Fenwick tree, 1-based
+    std::unordered_map<size_t, size_t> last;  // key -> time of last access
+    size_t now;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file sim_trace.hpp
+ * @author HUANG Qiyue
+ * @brief Recording of the simulator's access stream and parallel replay of
+ *        it against many buffer_t configurations.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * A trace file is a trace_header_t followed by one 32-bit record per access
+ * to a, b or c:
+ *     key << 3 | write << 2 | matrix     (matrix: 0 = a, 1 = b, 2 = c)
+ * where key = i * col + j. Replay drives buffers on null_storage_t, so no
+ * matrix file is needed and every configuration can run on its own thread.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef SIM_TRACE_H
+#define SIM_TRACE_H
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache_engines.hpp"
+#include "defs.h"
+#include "storage.hpp"
+#include "structures.hpp"
+
+using trace_record_t = uint32_t;
+const size_t TRACE_KEY_LIMIT = size_t(1) << 29;
+const size_t TRACE_BLOCK = 1 << 16;  // records per write
+
+struct trace_header_t {
+    uint32_t magic;
+    uint32_t row;  // every matrix in the trace is row x col
+    uint32_t col;
+    uint32_t reserved;
+    uint64_t count;  // number of records
+};
+
+class trace_writer_t {
+   public:
+    trace_writer_t(const char* filename, uint32_t row, uint32_t col)
+        : header{TRACE_MAGIC, row, col, 0, 0} {
+        /* keys past the limit would wrap in a record: write no trace at all,
+         * and drop a stale one so it is not replayed in its place */
+        if (size_t(row) * col > TRACE_KEY_LIMIT) {
+            std::cerr << "Matrix too large for a trace, nothing recorded.\n";
+            std::remove(filename);
+            return;
+        }
+        fs.open(filename, std::ios::out | std::ios::binary);
+        if (!fs) {
+            std::cerr << "Error opening file: " << filename << "\n";
+            return;
+        }
+        fs.write(reinterpret_cast<char*>(&header), sizeof(header));
+        block.reserve(TRACE_BLOCK);
+    }
+
+    ~trace_writer_t() {
+        if (!good()) return;
+        flush();
+        fs.seekp(0, std::ios::beg);
+        fs.write(reinterpret_cast<char*>(&header), sizeof(header));
+        fs.close();
+    }
+
+    /* false when the trace is refused or its file failed to open; then
+     * every record is dropped */
+    bool good() const { return fs.is_open(); }
+
+    void record(unsigned matrix, bool write, size_t key) {
+        if (!good()) return;
+        block.push_back(trace_record_t(key << 3 | write << 2 | matrix));
+        if (block.size() == TRACE_BLOCK) flush();
+    }
+
+    void flush() {
+        fs.write(reinterpret_cast<char*>(block.data()),
+                 block.size() * sizeof(trace_record_t));
+        header.count += block.size();
+        block.clear();
+    }
+
+    trace_header_t header;
+
+   private:
+    std::fstream fs;
+    std::vector<trace_record_t> block;
+};
+
+/**
+ * @brief Stands in for a buffer_t in the LOOP macro: every access is
+ *        appended to the trace and reads return T().
+ */
+template <class T>
+class trace_matrix_t {
+   private:
+    struct vector_t;
+
+   public:
+    trace_matrix_t(trace_writer_t& _writer, unsigned _id)
+        : writer(_writer), id(_id), col(_writer.header.col) {}
+
+    vector_t operator[](size_t i) { return vector_t(i, this); }
+
+    void assign(size_t i, size_t j, T /* val */) {
+        writer.record(id, true, i * col + j);
+    }
+
+    trace_writer_t& writer;
+    unsigned id;
+    uint32_t col;
+
+   private:
+    /* proxy class */
+    struct vector_t {
+        size_t i;
+        trace_matrix_t<T>* parent;
+        vector_t(size_t _i, trace_matrix_t<T>* e) : i(_i), parent(e) {}
+
+        const T operator[](size_t j) const {
+            parent->writer.record(parent->id, false, i * parent->col + j);
+            return T();
+        }
+    };
+};
+
+/**
+ * @brief A trace file mapped read-only, shared by all replay threads.
+ */
+struct trace_t {
+    explicit trace_t(const char* filename)
+        : file(new mmap_storage_t(filename, false)) {
+        if (!file->good()) return;
+        file->read(0, &header, sizeof(header));
+        if (header.magic != TRACE_MAGIC) {
+            std::cerr << "Not a trace file: " << filename << "\n";
+            return;
+        }
+        auto payload = file->data() + sizeof(header);
+        records = reinterpret_cast<const trace_record_t*>(payload);
+        count = header.count;
+    }
+
+    /* demand lookups a buffer with line_size makes for one matrix */
+    std::vector<size_t> demand_lines(unsigned matrix, size_t line_size) const {
+        std::vector<size_t> lines;
+        for (size_t n = 0; n < count; ++n) {
+            if ((records[n] & 3) == matrix)
+                lines.push_back((records[n] >> 3) / line_size);
+        }
+        return lines;
+    }
+
+    std::unique_ptr<storage_t> file;
+    trace_header_t header = {};
+    const trace_record_t* records = nullptr;
+    size_t count = 0;
+};
+
+struct replay_config_t {
+    size_t order;  // index of the trace to replay
+    size_t capacity;
+    size_t window;
+    size_t line_size;
+    std::string policy;  // LRU, CLOCK, 2Q, ARC, LIRS or OPT
+};
+
+struct replay_result_t {
+    uint64_t read[3];
+    uint64_t miss[3];
+};
+
+template <class Cache, class MakeCache>
+replay_result_t replay(const trace_t& trace, MakeCache make_cache,
+                       size_t window, size_t line_size) {
+    auto open = [&](unsigned id) {
+        return std::unique_ptr<buffer_t<uint32_t, Cache>>(
+            new buffer_t<uint32_t, Cache>(
+                std::unique_ptr<storage_t>(new null_storage_t(
+                    trace.header.row, trace.header.col, sizeof(uint32_t))),
+                make_cache(id), window, line_size));
+    };
+    std::unique_ptr<buffer_t<uint32_t, Cache>> buffers[3] = {open(0), open(1),
+                                                             open(2)};
+
+    size_t col = trace.header.col;
+    for (size_t n = 0; n < trace.count; ++n) {
+        auto record = trace.records[n];
+        auto& buffer = *buffers[record & 3];
+        size_t key = record >> 3;
+        if (record & 4)
+            buffer.assign(key / col, key % col, 0);
+        else
+            buffer.read(key / col, key % col);
+    }
+
+    replay_result_t result;
+    for (unsigned id = 0; id < 3; ++id) {
+        result.read[id] = buffers[id]->read_count;
+        result.miss[id] = buffers[id]->miss_count;
+    }
+    return result;
+}
+
+inline replay_result_t replay(const trace_t& trace,
+                              const replay_config_t& config) {
+    auto capacity = config.capacity;
+    auto window = config.window;
+    auto line_size = config.line_size;
+    auto& policy = config.policy;
+    if (policy == "CLOCK")
+        return replay<clock_cache_t>(
+            trace, [&](unsigned) { return clock_cache_t(capacity); }, window,
+            line_size);
+    if (policy == "2Q")
+        return replay<two_queue_t>(
+            trace, [&](unsigned) { return two_queue_t(capacity); }, window,
+            line_size);
+    if (policy == "ARC")
+        return replay<arc_t>(
+            trace, [&](unsigned) { return arc_t(capacity); }, window,
+            line_size);
+    if (policy == "LIRS")
+        return replay<lirs_t>(
+            trace, [&](unsigned) { return lirs_t(capacity); }, window,
+            line_size);
+    if (policy == "OPT")
+        return replay<opt_t>(
+            trace,
+            [&](unsigned id) {
+                return opt_t(capacity, trace.demand_lines(id, line_size));
+            },
+            window, line_size);
+    if (policy != "LRU") std::cerr << "Unknown policy " << policy << "\n";
+    return replay<flat_lru_t>(
+        trace, [&](unsigned) { return flat_lru_t(capacity); }, window,
+        line_size);
+}
+
+/**
+ * @brief Replays every configuration, spread over nthreads threads.
+ *        Results come back in the order of configs.
+ */
+inline std::vector<replay_result_t> replay_all(
+    const std::vector<std::unique_ptr<trace_t>>& traces,
+    const std::vector<replay_config_t>& configs, size_t nthreads) {
+    std::vector<replay_result_t> results(configs.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nthreads; ++t) {
+        workers.emplace_back([&]() {
+            for (size_t n = next++; n < configs.size(); n = next++)
+                results[n] = replay(*traces[configs[n].order], configs[n]);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return results;
+}
+
+#endif
@@ -10,11 +10,19 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <fstream>
 #include <iostream>
 #include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "concurrent_buffer.hpp"
 #include "defs.h"
+#include "hierarchy.hpp"
+#include "sim_trace.hpp"
 #include "structures.hpp"
 
 matrix_t<uint32_t> generate_matrix(uint32_t r, uint32_t c) {
@@ -25,18 +33,28 @@ matrix_t<uint32_t> generate_matrix(uint32_t r, uint32_t c) {
     m32.size_of_T = sizeof(uint32_t);
     m32.row = r;
     m32.col = c;
+    m32.layout = LAYOUT_ROW_MAJOR;
+    m32.header_size = MATRIX_ARR_OFFSET;
+    if (!m32.allocate()) {
+        std::cerr << "Out of memory for a " << r << " x " << c
+                  << " matrix.\n";
+        return matrix_t<uint32_t>{};
+    }
 
-    auto arr = new uint32_t*[r];
-    /* generate random number */
-    std::mt19937 rng(std::random_device{}());
-    for (auto i = 0; i < r; ++i) {
-        arr[i] = new uint32_t[c];
-        for (auto j = 0; j < c; ++j) {
-            arr[i][j] = rng();
-        }
+    /* generate random number, one band of rows per thread */
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min<size_t>(nthreads, std::max(1u, r));
+    std::random_device seeder;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nthreads; ++t) {
+        size_t first = r * t / nthreads, last = r * (t + 1) / nthreads;
+        workers.emplace_back([&m32, first, last, seed = seeder()]() {
+            std::mt19937 rng(seed);
+            std::generate(m32[first], m32[last], rng);
+        });
     }
+    for (auto& worker : workers) worker.join();
 
-    m32.arr = arr;
     return m32;
 }
 
@@ -49,47 +67,66 @@ void dump_matrix(matrix_t<T>& mat, const char* filename) {
         return;
     }
     /* dump metadata into file */
+    mat.header_size = MATRIX_ARR_OFFSET;
     fs.write(reinterpret_cast<char*>(&mat), MATRIX_METADATA * sizeof(uint32_t));
 
     /* dump array data into file */
-    for (auto i = 0; i < mat.row; ++i) {
-        for (auto j = 0; j < mat.col; ++j) {
-            fs.write(reinterpret_cast<char*>(&(mat.arr[i][j])), sizeof(T));
-        }
+    if (mat.layout != LAYOUT_ROW_MAJOR) {
+        std::vector<T> z(layout_elements(mat.layout, mat.row, mat.col), T());
+        for (size_t i = 0; i < mat.row; ++i)
+            for (size_t j = 0; j < mat.col; ++j)
+                z[layout_index(mat.layout, mat.row, mat.col, i, j)] =
+                    mat[i][j];
+        fs.write(reinterpret_cast<char*>(z.data()), z.size() * sizeof(T));
+    } else {
+        fs.write(reinterpret_cast<char*>(mat.arr), mat.payload_size());
     }
     fs.close();
 }
 
 template <class T>
-matrix_t<T> load_matrix(const char* filename) {
-    matrix_t<T> mat = {0};
+matrix_t<T> load_matrix(const char* filename,
+                        storage_mode_t mode = STORAGE_FSTREAM) {
+    matrix_t<T> mat = {};
 
     /* Create file object and open file */
-    std::fstream fs(filename, std::ios::in | std::ios::binary);
-    if (!fs) {
+    auto file = open_storage(filename, mode, false);
+    if (!file->good()) {
         std::cerr << "Error opening file. Aborting.\n";
         return mat;
     }
-    /* read metadata from file */
-    fs.read((char*)&mat.magic, sizeof(uint32_t));
-    fs.read((char*)&mat.row, sizeof(uint32_t));
-    fs.read((char*)&mat.col, sizeof(uint32_t));
-    fs.read((char*)&mat.size_of_T, sizeof(uint32_t));
-
-    /* initialize array */
-    mat.arr = new uint32_t*[mat.row];
-    for (auto i = 0; i < mat.row; ++i) {
-        mat.arr[i] = new uint32_t[mat.col];
+    /* read metadata from file, and check it against the file */
+    file->read(0, &mat, MATRIX_ARR_OFFSET);
+    size_t bytes = file->size();
+    size_t elements = layout_elements(mat.layout, mat.row, mat.col);
+    if (!file->good() || !mat.header_ok() || mat.size_of_T != sizeof(T) ||
+        bytes < MATRIX_ARR_OFFSET ||
+        elements > (bytes - MATRIX_ARR_OFFSET) / sizeof(T)) {
+        std::cerr << filename << " is not the matrix its header describes.\n";
+        return matrix_t<T>{};
     }
 
     /* read array data from file */
-    for (auto i = 0; i < mat.row; ++i) {
-        for (auto j = 0; j < mat.col; ++j) {
-            fs.read((char*)&mat.arr[i][j], sizeof(T));
-        }
+    if (!mat.allocate()) {
+        std::cerr << "Out of memory for " << filename << ".\n";
+        return matrix_t<T>{};
+    }
+    if (mat.layout != LAYOUT_ROW_MAJOR) {
+        std::vector<T> z(layout_elements(mat.layout, mat.row, mat.col));
+        file->read(MATRIX_ARR_OFFSET, z.data(), z.size() * sizeof(T));
+        for (size_t i = 0; i < mat.row; ++i)
+            for (size_t j = 0; j < mat.col; ++j)
+                mat[i][j] =
+                    z[layout_index(mat.layout, mat.row, mat.col, i, j)];
+    } else {
+        file->read(MATRIX_ARR_OFFSET, mat.arr, mat.payload_size());
+    }
+    if (!file->good()) {
+        std::cerr << "Error reading " << filename << ".\n";
+        std::free(mat.arr);
+        return matrix_t<T>{};
     }
 
-    fs.close();
     return mat;
 }
 
@@ -101,18 +138,72 @@ matrix_t<T> load_matrix(const char* filename) {
             }                                                \
         }                                                    \
     }
-#define SHOW_STAT(_x)                                             \
-    printf("==" #_x "==\nRead: %d, Miss: %d, Miss Ratio: %.3f\n", \
-           _x.read_count, _x.miss_count, _x.miss_rate());
+/* LOOP over _a in [_a##0, _a##1) and likewise for _b and _c */
+#define LOOP_RANGE(_a, _b, _c)                               \
+    for (size_t _a = _a##0; _a < _a##1; ++_a) {              \
+        for (size_t _b = _b##0; _b < _b##1; ++_b) {          \
+            for (size_t _c = _c##0; _c < _c##1; ++_c) {      \
+                c.assign(i, j, c[i][j] + a[i][k] * b[k][j]); \
+            }                                                \
+        }                                                    \
+    }
+/* LOOP in tiles of Ti x Tj x Tk, the tiles visited in the same order */
+#define TILED_LOOP(_a, _b, _c)                                            \
+    for (size_t _a##t = 0; _a##t < N; _a##t += T##_a) {                   \
+        for (size_t _b##t = 0; _b##t < N; _b##t += T##_b) {               \
+            for (size_t _c##t = 0; _c##t < N; _c##t += T##_c) {           \
+                size_t _a##0 = _a##t, _a##1 = std::min(N, _a##t + T##_a); \
+                size_t _b##0 = _b##t, _b##1 = std::min(N, _b##t + T##_b); \
+                size_t _c##0 = _c##t, _c##1 = std::min(N, _c##t + T##_c); \
+                LOOP_RANGE(_a, _b, _c);                                   \
+            }                                                             \
+        }                                                                 \
+    }
+#define SHOW_STAT(_x)                                                     \
+    printf("==" #_x "==\nRead: %" PRIu64 ", Miss: %" PRIu64                \
+           ", Miss Ratio: %.3f, Latency: %.1f ns\n"                        \
+           "Line Read: %" PRIu64 ", Line Miss: %" PRIu64                    \
+           ", Line Miss Ratio: %.3f\n"                                     \
+           "Lines Loaded: %" PRIu64 ", Bytes Read: %" PRIu64 "\n"           \
+           "Write-backs: %" PRIu64 ", Write Ops: %" PRIu64                  \
+           ", Bytes Written: %" PRIu64 "\n"                                 \
+           "Pre-fetched: %" PRIu64 ", Useful: %" PRIu64                     \
+           ", Wasted: %" PRIu64 ", Accuracy: %.3f\n",                       \
+           _x.read_count, _x.miss_count, _x.miss_rate(), _x.read_latency(), \
+           _x.line_read_count, _x.line_miss_count, _x.line_miss_rate(),     \
+           _x.line_load_count, _x.bytes_read, _x.writeback_count,           \
+           _x.write_op_count, _x.bytes_written, _x.prefetch_count,          \
+           _x.prefetch_useful, _x.prefetch_wasted, _x.prefetch_accuracy());
 #define SHOW_STATS SHOW_STAT(a) SHOW_STAT(b) SHOW_STAT(c)
 #define RESET a.reset_counters();b.reset_counters();c.reset_counters();
+#define FLUSH a.flush();b.flush();c.flush();
+#define SHOW_MRC(_x, _order) \
+    if (_x.profiler) write_mrc(mrc, _order, #_x, *_x.profiler);
+#define SHOW_MRCS(_order) \
+    SHOW_MRC(a, _order) SHOW_MRC(b, _order) SHOW_MRC(c, _order)
 #define RUN_SIM(_a, _b, _c)    \
     printf(#_a #_b #_c ":\n"); \
     RESET;                     \
     LOOP(_a, _b, _c);          \
+    FLUSH;                     \
     SHOW_STATS;                \
+    SHOW_MRCS(#_a #_b #_c);    \
     printf("\n\n");
-void run_simulation(size_t N, size_t capacity, size_t window) {
+
+/* LRU miss-ratio curve of one matrix, one CSV row per step of the curve */
+void write_mrc(std::ostream& out, const char* order, const char* matrix,
+               const reuse_distance_t& profiler) {
+    for (auto& point : profiler.curve()) {
+        out << order << ',' << matrix << ',' << point.first << ','
+            << point.second << '\n';
+    }
+}
+
+void run_simulation(size_t N, size_t capacity, size_t window,
+                    size_t line_size = 1,
+                    write_policy_t write_policy = WRITE_THROUGH,
+                    storage_mode_t storage_mode = STORAGE_FSTREAM,
+                    const char* mrc_csv = nullptr) {
     auto ma = generate_matrix(N, N);
     auto mb = generate_matrix(N, N);
     auto mc = generate_matrix(N, N);
@@ -120,9 +211,23 @@ void run_simulation(size_t N, size_t capacity, size_t window) {
     dump_matrix(mb, "b.dat");
     dump_matrix(mc, "c.dat");
 
-    buffer_t<uint32_t> a("a.dat", capacity, window);
-    buffer_t<uint32_t> b("b.dat", capacity, window);
-    buffer_t<uint32_t> c("c.dat", capacity, window);
+    buffer_t<uint32_t, flat_lru_t> a("a.dat", capacity, window, line_size,
+                                     write_policy, storage_mode);
+    buffer_t<uint32_t, flat_lru_t> b("b.dat", capacity, window, line_size,
+                                     write_policy, storage_mode);
+    buffer_t<uint32_t, flat_lru_t> c("c.dat", capacity, window, line_size,
+                                     write_policy, storage_mode);
+
+    /* optional miss-ratio curves of every capacity from the same pass */
+    std::fstream mrc;
+    reuse_distance_t profilers[3];
+    if (mrc_csv) {
+        mrc.open(mrc_csv, std::ios::out);
+        mrc << "loop_order,matrix,capacity,miss_ratio\n";
+        a.profiler = &profilers[0];
+        b.profiler = &profilers[1];
+        c.profiler = &profilers[2];
+    }
 
     RUN_SIM(i, j, k);
     RUN_SIM(i, k, j);
@@ -134,15 +239,710 @@ void run_simulation(size_t N, size_t capacity, size_t window) {
 
 template <class T>
 void free_matrix(matrix_t<T>& mat) {
-    for (auto i = 0; i < mat.row; ++i) {
-        delete[] mat.arr[i];
+    std::free(mat.arr);
+    mat.arr = nullptr;
+}
+
+/* {read, miss} of a, b, c for each of the six loop orders, in RUN_SIM order */
+using policy_stats_t = std::vector<std::pair<uint64_t, uint64_t>>;
+
+#define COLLECT_STAT(_x) stats.push_back({_x.read_count, _x.miss_count});
+#define COLLECT_STATS COLLECT_STAT(a) COLLECT_STAT(b) COLLECT_STAT(c)
+#define RUN_SIM_QUIET(_a, _b, _c) \
+    RESET;                        \
+    LOOP(_a, _b, _c);             \
+    COLLECT_STATS;
+const char* const loop_orders[] = {"ijk", "ikj", "jik", "jki", "kij", "kji"};
+
+template <class Cache>
+policy_stats_t simulate(size_t N, buffer_t<uint32_t, Cache>& a,
+                        buffer_t<uint32_t, Cache>& b,
+                        buffer_t<uint32_t, Cache>& c) {
+    policy_stats_t stats;
+    RUN_SIM_QUIET(i, j, k);
+    RUN_SIM_QUIET(i, k, j);
+    RUN_SIM_QUIET(j, i, k);
+    RUN_SIM_QUIET(j, k, i);
+    RUN_SIM_QUIET(k, i, j);
+    RUN_SIM_QUIET(k, j, i);
+    return stats;
+}
+
+template <class Cache>
+policy_stats_t simulate_policy(size_t N, size_t capacity, size_t window,
+                               size_t line_size) {
+    buffer_t<uint32_t, Cache> a("a.dat", capacity, window, line_size);
+    buffer_t<uint32_t, Cache> b("b.dat", capacity, window, line_size);
+    buffer_t<uint32_t, Cache> c("c.dat", capacity, window, line_size);
+    return simulate(N, a, b, c);
+}
+
+/* Belady's OPT: record the lookups of an LRU run, then replay with opt_t */
+policy_stats_t simulate_opt(size_t N, size_t capacity, size_t window,
+                            size_t line_size) {
+    using recorder = trace_recorder_t<flat_lru_t>;
+    buffer_t<uint32_t, recorder> ra("a.dat", capacity, window, line_size);
+    buffer_t<uint32_t, recorder> rb("b.dat", capacity, window, line_size);
+    buffer_t<uint32_t, recorder> rc("c.dat", capacity, window, line_size);
+    simulate(N, ra, rb, rc);
+
+    buffer_t<uint32_t, opt_t> a("a.dat", opt_t(capacity, ra.cache.trace),
+                                window, line_size);
+    buffer_t<uint32_t, opt_t> b("b.dat", opt_t(capacity, rb.cache.trace),
+                                window, line_size);
+    buffer_t<uint32_t, opt_t> c("c.dat", opt_t(capacity, rc.cache.trace),
+                                window, line_size);
+    return simulate(N, a, b, c);
+}
+
+/* miss ratio of every policy side by side, same N, capacity and window */
+void compare_policies(size_t N, size_t capacity, size_t window,
+                      size_t line_size = 1) {
+    auto ma = generate_matrix(N, N);
+    auto mb = generate_matrix(N, N);
+    auto mc = generate_matrix(N, N);
+    dump_matrix(ma, "a.dat");
+    dump_matrix(mb, "b.dat");
+    dump_matrix(mc, "c.dat");
+    free_matrix(ma);
+    free_matrix(mb);
+    free_matrix(mc);
+
+    std::vector<std::string> names = {"LRU",  "CLOCK", "2Q",
+                                      "ARC",  "LIRS",  "OPT"};
+    std::vector<policy_stats_t> results = {
+        simulate_policy<flat_lru_t>(N, capacity, window, line_size),
+        simulate_policy<clock_cache_t>(N, capacity, window, line_size),
+        simulate_policy<two_queue_t>(N, capacity, window, line_size),
+        simulate_policy<arc_t>(N, capacity, window, line_size),
+        simulate_policy<lirs_t>(N, capacity, window, line_size),
+        simulate_opt(N, capacity, window, line_size)};
+
+    printf("N: %zu, Capacity: %zu, Window: %zu, Line Size: %zu\n", N,
+           capacity, window, line_size);
+    printf("%-6s%-7s%9s", "Order", "Matrix", "Read");
+    for (auto& name : names) printf("%8s", name.c_str());
+    printf("\n");
+    for (size_t row = 0; row < results[0].size(); ++row) {
+        printf("%-6s%-7c%9" PRIu64, loop_orders[row / 3], "abc"[row % 3],
+               results[0][row].first);
+        for (auto& result : results)
+            printf("%8.3f", 1.0f * result[row].second / result[row].first);
+        printf("\n");
+    }
+    printf("\n\n");
+}
+
+#define RUN_TILED_SIM(_a, _b, _c)                                \
+    printf(#_a #_b #_c " tiled %zux%zux%zu:\n", Ti, Tj, Tk);    \
+    RESET;                                                      \
+    TILED_LOOP(_a, _b, _c);                                     \
+    FLUSH;                                                      \
+    SHOW_STATS;                                                 \
+    printf("\n\n");
+
+/* run_simulation with tiles of Ti x Tj x Tk */
+void run_tiled_simulation(size_t N, size_t capacity, size_t window,
+                          size_t Ti, size_t Tj, size_t Tk,
+                          size_t line_size = 1) {
+    auto ma = generate_matrix(N, N);
+    auto mb = generate_matrix(N, N);
+    auto mc = generate_matrix(N, N);
+    dump_matrix(ma, "a.dat");
+    dump_matrix(mb, "b.dat");
+    dump_matrix(mc, "c.dat");
+    free_matrix(ma);
+    free_matrix(mb);
+    free_matrix(mc);
+
+    buffer_t<uint32_t, flat_lru_t> a("a.dat", capacity, window, line_size);
+    buffer_t<uint32_t, flat_lru_t> b("b.dat", capacity, window, line_size);
+    buffer_t<uint32_t, flat_lru_t> c("c.dat", capacity, window, line_size);
+
+    RUN_TILED_SIM(i, j, k);
+    RUN_TILED_SIM(i, k, j);
+    RUN_TILED_SIM(j, i, k);
+    RUN_TILED_SIM(j, k, i);
+    RUN_TILED_SIM(k, i, j);
+    RUN_TILED_SIM(k, j, i);
+}
+
+/* an N x N buffer with no file behind it, for counting misses only */
+std::unique_ptr<buffer_t<uint32_t, flat_lru_t>> null_buffer(
+    size_t N, size_t capacity, size_t window, size_t line_size,
+    uint32_t layout = LAYOUT_ROW_MAJOR) {
+    return std::unique_ptr<buffer_t<uint32_t, flat_lru_t>>(
+        new buffer_t<uint32_t, flat_lru_t>(
+            std::unique_ptr<storage_t>(
+                new null_storage_t(N, N, sizeof(uint32_t), layout)),
+            flat_lru_t(capacity), window, line_size));
+}
+
+/* read misses of a, b and c together for one tiled order on cold caches */
+uint64_t tiled_misses(size_t N, size_t order, size_t Ti, size_t Tj,
+                      size_t Tk, size_t capacity, size_t window,
+                      size_t line_size) {
+    auto pa = null_buffer(N, capacity, window, line_size);
+    auto pb = null_buffer(N, capacity, window, line_size);
+    auto pc = null_buffer(N, capacity, window, line_size);
+    auto &a = *pa, &b = *pb, &c = *pc;
+    switch (order) {
+        case 0: TILED_LOOP(i, j, k); break;
+        case 1: TILED_LOOP(i, k, j); break;
+        case 2: TILED_LOOP(j, i, k); break;
+        case 3: TILED_LOOP(j, k, i); break;
+        case 4: TILED_LOOP(k, i, j); break;
+        case 5: TILED_LOOP(k, j, i); break;
     }
+    return a.miss_count + b.miss_count + c.miss_count;
+}
+
+struct tile_result_t {
+    uint64_t misses;
+    size_t tile[3];  // Ti, Tj, Tk
+};
+
+/* tile sizes among the powers of two below N and N with fewest misses */
+tile_result_t best_tile(size_t N, size_t order, size_t capacity,
+                        size_t window, size_t line_size) {
+    std::vector<size_t> sizes;
+    for (size_t t = 1; t < N; t *= 2) sizes.push_back(t);
+    sizes.push_back(N);
 
-    delete[] mat.arr;
+    tile_result_t best = {
+        tiled_misses(N, order, N, N, N, capacity, window, line_size),
+        {N, N, N}};
+    for (auto Ti : sizes)
+        for (auto Tj : sizes)
+            for (auto Tk : sizes) {
+                auto misses = tiled_misses(N, order, Ti, Tj, Tk, capacity,
+                                           window, line_size);
+                if (misses < best.misses) best = {misses, {Ti, Tj, Tk}};
+            }
+    return best;
+}
+
+/**
+ * @brief For each loop order, reports the tile with the fewest read misses
+ *        against the untiled order. No file is read: the buffers sit on
+ *        null_storage_t.
+ */
+void search_tiles(size_t N, size_t capacity, size_t window,
+                  size_t line_size = 1) {
+    printf("N: %zu, Capacity: %zu, Window: %zu, Line Size: %zu\n", N,
+           capacity, window, line_size);
+    printf("%-6s%10s%16s%10s\n", "Order", "Untiled", "Best Tile", "Misses");
+    for (size_t order = 0; order < 6; ++order) {
+        uint64_t untiled =
+            tiled_misses(N, order, N, N, N, capacity, window, line_size);
+        auto best = best_tile(N, order, capacity, window, line_size);
+        auto tile = std::to_string(best.tile[0]) + "x" +
+                    std::to_string(best.tile[1]) + "x" +
+                    std::to_string(best.tile[2]);
+        printf("%-6s%10" PRIu64 "%16s%10" PRIu64 "\n", loop_orders[order],
+               untiled, tile.c_str(), best.misses);
+    }
+    printf("\n\n");
+}
+
+/* the recursion stops at blocks of at most this many multiply-adds */
+const size_t RECURSIVE_BASE = 8;
+
+/**
+ * @brief Cache-oblivious multiply: c += a * b over [i0, i1) x [j0, j1) x
+ *        [k0, k1), halving the largest of the three ranges until the block
+ *        is small enough for LOOP_RANGE. No tile size to tune.
+ */
+template <class A, class B, class C>
+void recursive_multiply(A& a, B& b, C& c, size_t i0, size_t i1, size_t j0,
+                        size_t j1, size_t k0, size_t k1) {
+    size_t di = i1 - i0, dj = j1 - j0, dk = k1 - k0;
+    if (di * dj * dk <= RECURSIVE_BASE) {
+        LOOP_RANGE(i, j, k);
+        return;
+    }
+    if (di >= dj && di >= dk) {
+        size_t mid = i0 + di / 2;
+        recursive_multiply(a, b, c, i0, mid, j0, j1, k0, k1);
+        recursive_multiply(a, b, c, mid, i1, j0, j1, k0, k1);
+    } else if (dj >= dk) {
+        size_t mid = j0 + dj / 2;
+        recursive_multiply(a, b, c, i0, i1, j0, mid, k0, k1);
+        recursive_multiply(a, b, c, i0, i1, mid, j1, k0, k1);
+    } else {
+        size_t mid = k0 + dk / 2;
+        recursive_multiply(a, b, c, i0, i1, j0, j1, k0, mid);
+        recursive_multiply(a, b, c, i0, i1, j0, j1, mid, k1);
+    }
+}
+
+/* read misses of a, b and c together for the recursive multiply */
+uint64_t recursive_misses(size_t N, size_t capacity, size_t window,
+                          size_t line_size, matrix_layout_t layout) {
+    auto pa = null_buffer(N, capacity, window, line_size, layout);
+    auto pb = null_buffer(N, capacity, window, line_size, layout);
+    auto pc = null_buffer(N, capacity, window, line_size, layout);
+    recursive_multiply(*pa, *pb, *pc, 0, N, 0, N, 0, N);
+    return pa->miss_count + pb->miss_count + pc->miss_count;
+}
+
+/**
+ * @brief Miss ratio of every capacity for the best naive order, the best
+ *        ijk tiling, and the recursive multiply on row-major and Morton
+ *        files. Tiling is tuned per capacity; the recursion is not.
+ */
+void compare_layouts(size_t N, const std::vector<size_t>& capacities,
+                     size_t window = 1, size_t line_size = 4) {
+    double reads = 3.0 * N * N * N;
+    printf("N: %zu, Window: %zu, Line Size: %zu\n", N, window, line_size);
+    printf("%-10s%10s%10s%12s%10s%8s\n", "Capacity", "Naive", "Tiled",
+           "Tile", "Recursive", "Morton");
+    for (auto capacity : capacities) {
+        uint64_t naive = UINT64_MAX;
+        for (size_t order = 0; order < 6; ++order)
+            naive = std::min(naive, tiled_misses(N, order, N, N, N, capacity,
+                                                 window, line_size));
+        auto tiled = best_tile(N, 0, capacity, window, line_size);
+        auto tile = std::to_string(tiled.tile[0]) + "x" +
+                    std::to_string(tiled.tile[1]) + "x" +
+                    std::to_string(tiled.tile[2]);
+        auto row_major = recursive_misses(N, capacity, window, line_size,
+                                          LAYOUT_ROW_MAJOR);
+        auto morton =
+            recursive_misses(N, capacity, window, line_size, LAYOUT_MORTON);
+        printf("%-10zu%10.4f%10.4f%12s%10.4f%8.4f\n", capacity,
+               naive / reads, tiled.misses / reads, tile.c_str(),
+               row_major / reads, morton / reads);
+    }
+    printf("\n\n");
+}
+
+/**
+ * @brief Read misses of b per loop order, with b stored row-major and
+ *        transposed (as written by ooc_transpose). a and c stay row-major.
+ */
+void compare_transposed(size_t N, size_t capacity, size_t window,
+                        size_t line_size = 4) {
+    printf("N: %zu, Capacity: %zu, Window: %zu, Line Size: %zu\n", N,
+           capacity, window, line_size);
+    printf("%-6s%12s%12s\n", "Order", "Row-major", "Transposed");
+    uint32_t layouts[] = {LAYOUT_ROW_MAJOR,
+                          LAYOUT_ROW_MAJOR | LAYOUT_TRANSPOSED};
+    for (size_t order = 0; order < 6; ++order) {
+        uint64_t misses[2];
+        for (size_t t = 0; t < 2; ++t) {
+            auto pa = null_buffer(N, capacity, window, line_size);
+            auto pb = null_buffer(N, capacity, window, line_size, layouts[t]);
+            auto pc = null_buffer(N, capacity, window, line_size);
+            auto &a = *pa, &b = *pb, &c = *pc;
+            switch (order) {
+                case 0: LOOP(i, j, k); break;
+                case 1: LOOP(i, k, j); break;
+                case 2: LOOP(j, i, k); break;
+                case 3: LOOP(j, k, i); break;
+                case 4: LOOP(k, i, j); break;
+                case 5: LOOP(k, j, i); break;
+            }
+            misses[t] = b.miss_count;
+        }
+        printf("%-6s%12" PRIu64 "%12" PRIu64 "\n", loop_orders[order],
+               misses[0], misses[1]);
+    }
+    printf("\n\n");
+}
+
+/* miss ratio, pre-fetch accuracy and read latency of a, b, c per order */
+struct prefetch_stat_t {
+    float miss;
+    float accuracy;
+    float latency;  // ns per read
+};
+using prefetch_stats_t = std::vector<prefetch_stat_t>;
+
+#define COLLECT_PREFETCH(_x)                                          \
+    stats.push_back(                                                  \
+        {_x.miss_rate(), _x.prefetch_accuracy(), _x.read_latency()});
+#define RUN_SIM_PREFETCH(_a, _b, _c) \
+    RESET;                           \
+    LOOP(_a, _b, _c);                \
+    FLUSH;                           \
+    COLLECT_PREFETCH(a) COLLECT_PREFETCH(b) COLLECT_PREFETCH(c)
+
+prefetch_stats_t simulate_prefetch(size_t N, size_t capacity, size_t window,
+                                   prefetch_policy_t policy, bool async) {
+    buffer_t<uint32_t, flat_lru_t> a("a.dat", capacity, window);
+    buffer_t<uint32_t, flat_lru_t> b("b.dat", capacity, window);
+    buffer_t<uint32_t, flat_lru_t> c("c.dat", capacity, window);
+    a.prefetch_policy = b.prefetch_policy = c.prefetch_policy = policy;
+    if (async) {
+        a.start_prefetcher();
+        b.start_prefetcher();
+        c.start_prefetcher();
+    }
+
+    prefetch_stats_t stats;
+    RUN_SIM_PREFETCH(i, j, k);
+    RUN_SIM_PREFETCH(i, k, j);
+    RUN_SIM_PREFETCH(j, i, k);
+    RUN_SIM_PREFETCH(j, k, i);
+    RUN_SIM_PREFETCH(k, i, j);
+    RUN_SIM_PREFETCH(k, j, i);
+    return stats;
+}
+
+/* sequential, stride and background stride pre-fetch side by side */
+void compare_prefetch(size_t N, size_t capacity, size_t window) {
+    auto ma = generate_matrix(N, N);
+    auto mb = generate_matrix(N, N);
+    auto mc = generate_matrix(N, N);
+    dump_matrix(ma, "a.dat");
+    dump_matrix(mb, "b.dat");
+    dump_matrix(mc, "c.dat");
+    free_matrix(ma);
+    free_matrix(mb);
+    free_matrix(mc);
+
+    std::vector<const char*> names = {"Seq", "Stride", "Async"};
+    std::vector<prefetch_stats_t> results = {
+        simulate_prefetch(N, capacity, window, PREFETCH_SEQUENTIAL, false),
+        simulate_prefetch(N, capacity, window, PREFETCH_STRIDE, false),
+        simulate_prefetch(N, capacity, window, PREFETCH_STRIDE, true)};
+
+    printf("N: %zu, Capacity: %zu, Window: %zu\n", N, capacity, window);
+    printf("%-13s", "");
+    for (auto name : names) printf("%-21s", name);
+    printf("\n%-6s%-7s", "Order", "Matrix");
+    for (size_t n = 0; n < names.size(); ++n)
+        printf("%7s%7s%7s", "Miss", "Acc", "ns");
+    printf("\n");
+    for (size_t row = 0; row < results[0].size(); ++row) {
+        printf("%-6s%-7c", loop_orders[row / 3], "abc"[row % 3]);
+        for (auto& result : results)
+            printf("%7.3f%7.3f%7.1f", result[row].miss, result[row].accuracy,
+                   result[row].latency);
+        printf("\n");
+    }
+    printf("\n\n");
+}
+
+/**
+ * @brief ikj multiply with element accesses against the same multiply with
+ *        read_row() and assign_row(): row i of c is read once, accumulated
+ *        over k in memory and assigned once, and row k of b moves in one
+ *        call, leaving a plain loop the compiler can vectorize.
+ */
+void compare_row_access(size_t N, size_t capacity, size_t line_size) {
+    auto ma = generate_matrix(N, N);
+    auto mb = generate_matrix(N, N);
+    auto mc = generate_matrix(N, N);
+    dump_matrix(ma, "a.dat");
+    dump_matrix(mb, "b.dat");
+    dump_matrix(mc, "c.dat");
+    free_matrix(ma);
+    free_matrix(mb);
+    free_matrix(mc);
+
+    printf("N: %zu, Capacity: %zu, Line Size: %zu\n", N, capacity,
+           line_size);
+    printf("%-9s%-7s%12s%12s%10s\n", "Access", "Matrix", "Reads", "Misses",
+           "Seconds");
+    for (int span = 0; span < 2; ++span) {
+        buffer_t<uint32_t, flat_lru_t> a("a.dat", capacity, 1, line_size);
+        buffer_t<uint32_t, flat_lru_t> b("b.dat", capacity, 1, line_size);
+        buffer_t<uint32_t, flat_lru_t> c("c.dat", capacity, 1, line_size);
+        auto start = std::chrono::steady_clock::now();
+        if (!span) {
+            LOOP(i, k, j);
+        } else {
+            std::vector<uint32_t> b_row(N), c_row(N);
+            for (size_t i = 0; i < N; ++i) {
+                c[i].read(0, N, c_row.data());
+                for (size_t k = 0; k < N; ++k) {
+                    uint32_t aik = a[i][k];
+                    b[k].read(0, N, b_row.data());
+                    for (size_t j = 0; j < N; ++j) c_row[j] += aik * b_row[j];
+                }
+                c[i].assign(0, N, c_row.data());
+            }
+        }
+        c.flush();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        buffer_t<uint32_t, flat_lru_t>* buffers[] = {&a, &b, &c};
+        for (size_t m = 0; m < 3; ++m)
+            printf("%-9s%-7c%12" PRIu64 "%12" PRIu64 "%10.4f\n",
+                   span ? "Row" : "Element", "abc"[m], buffers[m]->read_count,
+                   buffers[m]->miss_count, elapsed.count());
+    }
+    printf("\n\n");
+}
+
+/**
+ * @brief Steady-state miss ratios without replaying the warm-up. One ikj
+ *        multiply warms the caches, which are saved and then run again in
+ *        place; fresh buffers load the snapshots and run the multiply
+ *        too. Under LRU the warm and continued runs miss alike.
+ */
+void warm_start(size_t N, size_t capacity, size_t line_size) {
+    auto ma = generate_matrix(N, N);
+    auto mb = generate_matrix(N, N);
+    auto mc = generate_matrix(N, N);
+    dump_matrix(ma, "a.dat");
+    dump_matrix(mb, "b.dat");
+    dump_matrix(mc, "c.dat");
+    free_matrix(ma);
+    free_matrix(mb);
+    free_matrix(mc);
+
+    const char* snapshots[] = {"a.snap", "b.snap", "c.snap"};
+    double cold[3], continued[3], warm[3];
+    for (int restored = 0; restored < 2; ++restored) {
+        buffer_t<uint32_t, flat_lru_t> a("a.dat", capacity, 1, line_size,
+                                         WRITE_BACK);
+        buffer_t<uint32_t, flat_lru_t> b("b.dat", capacity, 1, line_size,
+                                         WRITE_BACK);
+        buffer_t<uint32_t, flat_lru_t> c("c.dat", capacity, 1, line_size,
+                                         WRITE_BACK);
+        buffer_t<uint32_t, flat_lru_t>* buffers[] = {&a, &b, &c};
+        if (!restored) {
+            LOOP(i, k, j);
+            for (size_t m = 0; m < 3; ++m) {
+                cold[m] = buffers[m]->miss_rate();
+                buffers[m]->save_snapshot(snapshots[m]);
+            }
+        } else {
+            for (size_t m = 0; m < 3; ++m)
+                buffers[m]->load_snapshot(snapshots[m]);
+        }
+        for (auto buffer : buffers) buffer->reset_counters();
+        LOOP(i, k, j);
+        for (size_t m = 0; m < 3; ++m)
+            (restored ? warm : continued)[m] = buffers[m]->miss_rate();
+    }
+
+    printf("N: %zu, Capacity: %zu, Line Size: %zu, Order: ikj\n", N,
+           capacity, line_size);
+    printf("%-8s%10s%12s%10s\n", "Matrix", "Cold", "Continued", "Warm");
+    for (size_t m = 0; m < 3; ++m)
+        printf("%-8c%10.4f%12.4f%10.4f\n", "abc"[m], cold[m], continued[m],
+               warm[m]);
+    printf("\n\n");
+}
+
+/* rows of c split across nthreads threads sharing sharded buffers */
+#define RUN_PARALLEL_SIM(_a, _b, _c)                                      \
+    {                                                                     \
+        shared_a.reset_counters();                                        \
+        shared_b.reset_counters();                                        \
+        shared_c.reset_counters();                                        \
+        auto start = std::chrono::steady_clock::now();                    \
+        std::vector<std::thread> workers;                                 \
+        for (size_t t = 0; t < nthreads; ++t) {                           \
+            workers.emplace_back([&, t]() {                               \
+                auto a = shared_a.worker();                               \
+                auto b = shared_b.worker();                               \
+                auto c = shared_c.worker();                               \
+                size_t i0 = N * t / nthreads, i1 = N * (t + 1) / nthreads; \
+                size_t j0 = 0, j1 = N, k0 = 0, k1 = N;                    \
+                LOOP_RANGE(_a, _b, _c);                                   \
+            });                                                           \
+        }                                                                 \
+        for (auto& worker : workers) worker.join();                       \
+        shared_a.flush();                                                 \
+        shared_b.flush();                                                 \
+        shared_c.flush();                                                 \
+        std::chrono::duration<double, std::milli> ms =                    \
+            std::chrono::steady_clock::now() - start;                     \
+        printf("%-6s%8.1f%9.3f%9.3f%9.3f\n", #_a #_b #_c, ms.count(),     \
+               shared_a.miss_rate(), shared_b.miss_rate(),                \
+               shared_c.miss_rate());                                     \
+    }
+
+void run_parallel_simulation(size_t N, size_t capacity, size_t nshards,
+                             size_t nthreads, size_t line_size = 1) {
+    auto ma = generate_matrix(N, N);
+    auto mb = generate_matrix(N, N);
+    auto mc = generate_matrix(N, N);
+    dump_matrix(ma, "a.dat");
+    dump_matrix(mb, "b.dat");
+    dump_matrix(mc, "c.dat");
+    free_matrix(ma);
+    free_matrix(mb);
+    free_matrix(mc);
+
+    concurrent_buffer_t<uint32_t> shared_a("a.dat", capacity, nshards,
+                                           line_size);
+    concurrent_buffer_t<uint32_t> shared_b("b.dat", capacity, nshards,
+                                           line_size);
+    concurrent_buffer_t<uint32_t> shared_c("c.dat", capacity, nshards,
+                                           line_size);
+
+    printf("N: %zu, Capacity: %zu, Shards: %zu, Threads: %zu\n", N, capacity,
+           nshards, nthreads);
+    printf("%-6s%8s%9s%9s%9s\n", "Order", "ms", "a Miss", "b Miss",
+           "c Miss");
+    RUN_PARALLEL_SIM(i, j, k);
+    RUN_PARALLEL_SIM(i, k, j);
+    RUN_PARALLEL_SIM(j, i, k);
+    RUN_PARALLEL_SIM(j, k, i);
+    RUN_PARALLEL_SIM(k, i, j);
+    RUN_PARALLEL_SIM(k, j, i);
+    printf("\n\n");
+}
+
+/* per-level hits and misses and AMAT of a, b and c, summed over hierarchies */
+#define RUN_HIERARCHY(_a, _b, _c)                                          \
+    {                                                                      \
+        for (auto& h : hierarchies) h->reset_counters(), h->clear();       \
+        LOOP(_a, _b, _c);                                                  \
+        printf("%-6s", #_a #_b #_c);                                       \
+        uint64_t accesses = 0;                                             \
+        double cost = 0;                                                   \
+        for (size_t l = 0; l < levels.size(); ++l) {                       \
+            uint64_t hits = 0, misses = 0;                                 \
+            for (auto& h : hierarchies) {                                  \
+                hits += h->hit_count[l];                                   \
+                misses += h->miss_count[l];                                \
+            }                                                              \
+            printf("%10" PRIu64 "%10" PRIu64, hits, misses);               \
+        }                                                                  \
+        for (auto& h : hierarchies) {                                      \
+            accesses += h->access_count;                                   \
+            cost += h->total_cost;                                         \
+        }                                                                  \
+        printf("%10.2f\n", cost / accesses);                               \
+    }
+
+/**
+ * @brief Runs the six loop orders through a cache hierarchy, one shared by
+ *        a, b and c or a private one for each, and prints per-level hits
+ *        and misses with the average access time.
+ */
+void simulate_hierarchy(size_t N, const std::vector<level_config_t>& levels,
+                        double memory_latency, bool shared) {
+    std::vector<std::unique_ptr<cache_hierarchy_t>> hierarchies;
+    for (size_t n = 0; n < (shared ? 1 : 3); ++n)
+        hierarchies.emplace_back(
+            new cache_hierarchy_t(levels, memory_latency));
+
+    /* in a shared hierarchy, no line holds elements of two matrices */
+    size_t stride = 0;
+    if (shared) {
+        size_t line = levels.back().line_size;
+        stride = (N * N + line - 1) / line * line;
+    }
+    auto& ha = *hierarchies[0];
+    auto& hb = *hierarchies[shared ? 0 : 1];
+    auto& hc = *hierarchies[shared ? 0 : 2];
+    hierarchy_matrix_t<uint32_t> a(ha, 0, N);
+    hierarchy_matrix_t<uint32_t> b(hb, stride, N);
+    hierarchy_matrix_t<uint32_t> c(hc, 2 * stride, N);
+
+    printf("N: %zu, %s hierarchy, Memory Latency: %.1f\n", N,
+           shared ? "Shared" : "Private", memory_latency);
+    for (size_t l = 0; l < levels.size(); ++l) {
+        auto& level = levels[l];
+        printf("L%zu: %zu lines of %zu, %s, %s, Latency %.1f\n", l + 1,
+               level.capacity, level.line_size, level.policy.c_str(),
+               l == 0 ? "-"
+               : level.inclusion == INCLUSIVE ? "Inclusive"
+                                              : "Exclusive",
+               level.latency);
+    }
+    printf("%-6s", "Order");
+    for (size_t l = 0; l < levels.size(); ++l)
+        printf("%8s%zu%s%8s%zu%s", "L", l + 1, "H", "L", l + 1, "M");
+    printf("%10s\n", "AMAT");
+    RUN_HIERARCHY(i, j, k);
+    RUN_HIERARCHY(i, k, j);
+    RUN_HIERARCHY(j, i, k);
+    RUN_HIERARCHY(j, k, i);
+    RUN_HIERARCHY(k, i, j);
+    RUN_HIERARCHY(k, j, i);
+    printf("\n\n");
+}
+
+/* record the access stream of each loop order into TRACE_PREFIX<order> */
+#define RECORD_SIM(_a, _b, _c)                                 \
+    {                                                          \
+        trace_writer_t writer(TRACE_PREFIX #_a #_b #_c, N, N); \
+        trace_matrix_t<uint32_t> a(writer, 0);                 \
+        trace_matrix_t<uint32_t> b(writer, 1);                 \
+        trace_matrix_t<uint32_t> c(writer, 2);                 \
+        LOOP(_a, _b, _c);                                      \
+    }
+void record_traces(size_t N) {
+    RECORD_SIM(i, j, k);
+    RECORD_SIM(i, k, j);
+    RECORD_SIM(j, i, k);
+    RECORD_SIM(j, k, i);
+    RECORD_SIM(k, i, j);
+    RECORD_SIM(k, j, i);
+}
+
+/* replay the recorded traces under every combination, one CSV row each */
+void replay_traces(const std::vector<size_t>& capacities,
+                   const std::vector<size_t>& windows,
+                   const std::vector<std::string>& policies,
+                   const char* csv_name, size_t line_size = 1) {
+    std::vector<std::unique_ptr<trace_t>> traces;
+    for (auto order : loop_orders) {
+        auto trace_name = std::string(TRACE_PREFIX) + order;
+        traces.emplace_back(new trace_t(trace_name.c_str()));
+    }
+
+    std::vector<replay_config_t> configs;
+    for (size_t order = 0; order < traces.size(); ++order)
+        for (auto capacity : capacities)
+            for (auto window : windows)
+                for (auto& policy : policies)
+                    configs.push_back(
+                        {order, capacity, window, line_size, policy});
+
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    auto results = replay_all(traces, configs, nthreads);
+
+    std::fstream csv(csv_name, std::ios::out);
+    csv << "loop_order,matrix,capacity,window,policy,read,miss,miss_ratio\n";
+    for (size_t n = 0; n < configs.size(); ++n) {
+        auto& config = configs[n];
+        for (unsigned id = 0; id < 3; ++id) {
+            auto read = results[n].read[id], miss = results[n].miss[id];
+            csv << loop_orders[config.order] << ',' << "abc"[id] << ','
+                << config.capacity << ',' << config.window << ','
+                << config.policy << ',' << read << ',' << miss << ','
+                << 1.0 * miss / read << '\n';
+        }
+    }
+    std::cout << "Replayed " << configs.size() << " configurations into "
+              << csv_name << std::endl;
 }
 
 int main() {
     run_simulation(30, 10, 10);
+    run_simulation(30, 10, 10, 1, WRITE_BACK);
+    run_simulation(30, 10, 10, 1, WRITE_THROUGH, STORAGE_MMAP, "mrc.csv");
+    compare_policies(30, 10, 10);
+    compare_prefetch(30, 10, 10);
+    compare_row_access(64, 32, 16);
+    warm_start(30, 256, 4);
+    run_parallel_simulation(30, 40, 4, 4);
+    run_tiled_simulation(30, 10, 1, 4, 4, 4);
+    search_tiles(30, 10, 1);
+    compare_layouts(32, {2, 4, 8, 16, 32, 64}, 1, 16);
+    compare_transposed(30, 10, 1);
+    simulate_hierarchy(30,
+                       {{8, 1, "LRU", INCLUSIVE, 1},
+                        {64, 4, "CLOCK", INCLUSIVE, 10}},
+                       100, true);
+    simulate_hierarchy(30,
+                       {{8, 4, "LRU", INCLUSIVE, 1},
+                        {64, 4, "LRU", EXCLUSIVE, 10},
+                        {512, 16, "LRU", INCLUSIVE, 30}},
+                       100, false);
+    record_traces(30);
+    replay_traces({5, 10, 20, 40}, {1, 10},
+                  {"LRU", "CLOCK", "2Q", "ARC", "LIRS", "OPT"}, "replay.csv");
     std::cout << "done\n";
     return 0;
 }
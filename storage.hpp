@@ -0,0 +1,199 @@
+/**
+ * @file storage.hpp
+ * @author HUANG Qiyue
+ * @brief Backends that buffer_t and load_matrix use to reach a matrix file.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * STORAGE_FSTREAM seeks and reads through std::fstream. STORAGE_MMAP maps
+ * the whole file, so an element is a pointer dereference away and the
+ * buffer above it only has to model the cache.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "defs.h"
+
+enum storage_mode_t { STORAGE_FSTREAM, STORAGE_MMAP };
+
+/**
+ * @brief Byte-addressed access to a file. Offsets are from the beginning of
+ *        the file, header included.
+ */
+class storage_t {
+   public:
+    virtual ~storage_t() = default;
+    virtual void read(size_t offset, void* dst, size_t bytes) = 0;
+    virtual void write(size_t offset, const void* src, size_t bytes) = 0;
+    virtual bool good() const = 0;
+    virtual bool writable() const { return true; }
+
+    /* bytes in the file, header included; 0 if it is not good() */
+    virtual size_t size() = 0;
+
+    /* start of the mapping, nullptr if the file is not memory-mapped */
+    virtual char* data() { return nullptr; }
+};
+
+class fstream_storage_t : public storage_t {
+   public:
+    explicit fstream_storage_t(const char* filename, bool writable = true)
+        : read_only(!writable) {
+        auto mode = std::ios::in | std::ios::binary;
+        if (writable) mode |= std::ios::out;
+        fs.open(filename, mode);
+        if (!fs) {
+            std::cerr << "Error opening file: " << filename << "\n";
+        }
+    }
+    ~fstream_storage_t() override { fs.close(); }
+
+    void read(size_t offset, void* dst, size_t bytes) override {
+        fs.seekg(offset, std::ios::beg);
+        fs.read(reinterpret_cast<char*>(dst), bytes);
+    }
+
+    /* a write to a read-only file fails the stream, see good() */
+    void write(size_t offset, const void* src, size_t bytes) override {
+        if (read_only) {
+            fs.setstate(std::ios::failbit);
+            return;
+        }
+        fs.seekp(offset, std::ios::beg);
+        fs.write(reinterpret_cast<const char*>(src), bytes);
+    }
+
+    bool good() const override { return fs.good(); }
+    bool writable() const override { return !read_only; }
+
+    size_t size() override {
+        if (!fs) return 0;
+        fs.seekg(0, std::ios::end);
+        return fs.tellg();
+    }
+
+   private:
+    std::fstream fs;
+    bool read_only;
+};
+
+class mmap_storage_t : public storage_t {
+   public:
+    explicit mmap_storage_t(const char* filename, bool writable = true)
+        : read_only(!writable) {
+        fd = ::open(filename, writable ? O_RDWR : O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            std::cerr << "Error opening file: " << filename << "\n";
+            return;
+        }
+        length = st.st_size;
+        int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* addr = mmap(nullptr, length, prot, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Error mapping file: " << filename << "\n";
+            return;
+        }
+        base = static_cast<char*>(addr);
+    }
+    ~mmap_storage_t() override {
+        if (base) munmap(base, length);
+        if (fd >= 0) ::close(fd);
+    }
+
+    /* past the end of the file, a read fills dst with zeros and a write is
+     * dropped, both failing the storage as a short fstream does */
+    void read(size_t offset, void* dst, size_t bytes) override {
+        if (!in_bounds(offset, bytes)) {
+            std::memset(dst, 0, bytes);
+            failed = true;
+            return;
+        }
+        std::memcpy(dst, base + offset, bytes);
+    }
+
+    /* the mapping of a read-only file is PROT_READ: refuse, see good() */
+    void write(size_t offset, const void* src, size_t bytes) override {
+        if (read_only || !in_bounds(offset, bytes)) {
+            failed = true;
+            return;
+        }
+        std::memcpy(base + offset, src, bytes);
+    }
+
+    bool good() const override { return base != nullptr && !failed; }
+    bool writable() const override { return !read_only; }
+    size_t size() override { return good() ? length : 0; }
+    char* data() override { return base; }
+
+   private:
+    bool in_bounds(size_t offset, size_t bytes) const {
+        return base && offset <= length && bytes <= length - offset;
+    }
+
+    int fd = -1;
+    char* base = nullptr;
+    size_t length = 0;
+    bool read_only;
+    bool failed = false;
+};
+
+/**
+ * @brief A file that is never touched: the header describes a row x col
+ *        matrix, payload reads return zeros and writes are dropped. Lets a
+ *        buffer model a cache from a trace alone.
+ */
+class null_storage_t : public storage_t {
+   public:
+    null_storage_t(uint32_t row, uint32_t col, uint32_t size_of_T,
+                   uint32_t layout = 0)
+        : header{MAGIC, row, col, size_of_T, layout,
+                 uint32_t(MATRIX_ARR_OFFSET)} {}
+
+    void read(size_t offset, void* dst, size_t bytes) override {
+        std::memset(dst, 0, bytes);
+        if (offset < sizeof(header))
+            std::memcpy(dst, reinterpret_cast<const char*>(header) + offset,
+                        std::min(bytes, sizeof(header) - offset));
+    }
+
+    void write(size_t /* offset */, const void* /* src */,
+               size_t /* bytes */) override {}
+
+    bool good() const override { return true; }
+
+    /* reads anywhere return zeros, so it holds any payload */
+    size_t size() override { return SIZE_MAX; }
+
+   private:
+    uint32_t header[MATRIX_METADATA];
+};
+
+/* filename through the backend of mode, read-only unless writable */
+inline std::unique_ptr<storage_t> open_storage(const char* filename,
+                                               storage_mode_t mode,
+                                               bool writable = true) {
+    if (mode == STORAGE_MMAP)
+        return std::unique_ptr<storage_t>(
+            new mmap_storage_t(filename, writable));
+    return std::unique_ptr<storage_t>(
+        new fstream_storage_t(filename, writable));
+}
+
+#endif
@@ -12,20 +12,88 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <list>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
-#include "LoserTree.hpp"
+#include "cache_engines.hpp"
 #include "defs.h"
 #include "extern/MinMaxHeap.hpp"
+#include "interval_heap.hpp"
+#include "reuse_distance.hpp"
+#include "storage.hpp"
+
+/**
+ * @brief Order of the elements in a matrix file. LAYOUT_MORTON stores the
+ *        matrix padded to a power-of-two square in Z-order, so that every
+ *        aligned 2^n x 2^n block is contiguous in the file.
+ */
+enum matrix_layout_t { LAYOUT_ROW_MAJOR, LAYOUT_MORTON };
+
+/**
+ * @brief Flag or-ed onto a matrix_layout_t: the payload holds the col x row
+ *        transpose in that layout. row and col stay those of the matrix, so
+ *        (i, j) is the same element with or without the flag; only its
+ *        position in the file changes, and columns become contiguous.
+ */
+const uint32_t LAYOUT_TRANSPOSED = 0x100;
+
+/* spread the low 32 bits of x over the even bits */
+inline uint64_t morton_spread(uint64_t x) {
+    x &= 0xFFFFFFFFULL;
+    x = (x | x << 16) & 0x0000FFFF0000FFFFULL;
+    x = (x | x << 8) & 0x00FF00FF00FF00FFULL;
+    x = (x | x << 4) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | x << 2) & 0x3333333333333333ULL;
+    x = (x | x << 1) & 0x5555555555555555ULL;
+    return x;
+}
+
+/* Z-order position of (i, j), j in the low bit so 2x2 blocks go row-wise */
+inline size_t morton_index(size_t i, size_t j) {
+    return morton_spread(i) << 1 | morton_spread(j);
+}
+
+/* element position of (i, j) in a file of the given layout */
+inline size_t layout_index(uint32_t layout, uint32_t row, uint32_t col,
+                           size_t i, size_t j) {
+    if (layout & LAYOUT_TRANSPOSED) {
+        std::swap(i, j);
+        std::swap(row, col);
+        layout &= ~LAYOUT_TRANSPOSED;
+    }
+    return layout == LAYOUT_MORTON ? morton_index(i, j) : i * col + j;
+}
+
+/* elements in the payload of a row x col matrix file */
+inline size_t layout_elements(uint32_t layout, uint32_t row, uint32_t col) {
+    if ((layout & ~LAYOUT_TRANSPOSED) != LAYOUT_MORTON)
+        return size_t(row) * col;
+    size_t side = 1;
+    while (side < std::max(row, col)) side <<= 1;
+    return side * side;
+}
 
 /**
  * @brief Defines a generic 2-D matrix with metadata.
  *
+ * The elements are one row-major block aligned to MATRIX_ALIGNMENT, so the
+ * payload can be moved to and from a file in a single call. mat[i] is a
+ * view of row i. layout is that of the file the matrix is dumped to or
+ * was loaded from; in memory the matrix is always row-major.
+ *
  * @tparam T Type of variables stored in the matrix.
  */
 template <class T>
@@ -36,44 +104,155 @@ struct matrix_t {
     uint32_t row;
     uint32_t col;
     uint32_t size_of_T;
+    uint32_t layout;       // matrix_layout_t
+    uint32_t header_size;  // MATRIX_ARR_OFFSET
+
+    /* row-major array */
+    T* arr;
+
+    /* a header of this format, not one of an older file */
+    bool header_ok() const {
+        return magic == MAGIC && header_size == MATRIX_ARR_OFFSET;
+    }
+
+    T* operator[](size_t i) { return arr + i * col; }
+    const T* operator[](size_t i) const { return arr + i * col; }
 
-    /* 2-D array */
-    T** arr;
+    size_t payload_size() const { return size_t(row) * col * sizeof(T); }
+
+    /* allocate arr for row x col elements; release with std::free
+     * @return false, arr nullptr, if the memory cannot be had */
+    bool allocate() {
+        size_t lines = (payload_size() + MATRIX_ALIGNMENT - 1) /
+                       MATRIX_ALIGNMENT;
+        size_t bytes = std::max<size_t>(lines, 1) * MATRIX_ALIGNMENT;
+        arr = static_cast<T*>(std::aligned_alloc(MATRIX_ALIGNMENT, bytes));
+        return arr != nullptr;
+    }
+};
+
+enum write_policy_t { WRITE_THROUGH, WRITE_BACK };
+enum prefetch_policy_t { PREFETCH_SEQUENTIAL, PREFETCH_STRIDE };
+
+const size_t SNAPSHOT_COUNTERS = 13;
+
+/**
+ * @brief Head of a buffer_t snapshot. count records follow, one uint64_t
+ *        per resident line in the engine's keys() order:
+ *            line << 2 | dirty << 1 | prefetched
+ *        each dirty record followed by the line's data unless the buffer
+ *        is mapped.
+ */
+struct snapshot_header_t {
+    uint32_t magic;
+    uint32_t row;
+    uint32_t col;
+    uint32_t layout;
+    uint64_t line_size;
+    uint64_t capacity;
+    uint64_t count;  // resident lines
+    uint64_t counters[SNAPSHOT_COUNTERS];
+    int64_t stride;
+    uint64_t stride_seen;
+    uint64_t last_line;
 };
 
 /**
  * @brief A buffer that takes in a file of matrix_t<T> as input,
- *        LRU as replacement algorithm,
- *        write-through as write policy,
+ *        a pluggable replacement engine (LRU by default),
+ *        write-through or write-back as write policy,
  *        and records buffer miss count against total read count.
  *
+ * The cache is organized in lines of line_size contiguous elements (in file
+ * order); a miss loads the whole line with one positioned read, and the
+ * window pre-fetches the following window - 1 lines.
+ *
+ * Under PREFETCH_STRIDE the window follows the stride between consecutive
+ * lines read instead, once the same stride has been seen twice in a row;
+ * a column walk then pre-fetches the next rows of the column. Each buffer
+ * is one access stream, as every matrix is read from one place in LOOP.
+ * Pre-fetched lines count as useful when a demand lookup hits them and as
+ * wasted when they are evicted untouched.
+ *
+ * After start_prefetcher() the window is filled by a background thread: a
+ * demand miss returns after its own read and only queues the rest. The
+ * cache and counters are then guarded by state_mutex and the file by
+ * io_mutex; the prefetcher reads a line holding only io_mutex, so hits and
+ * other buffers proceed meanwhile. A read of the line in flight waits for
+ * it and counts as a hit, a read of a line still queued takes it over as a
+ * miss. Miss counts then depend on timing. flush() waits for the queue to
+ * drain. read() time is accumulated in read_ns either way.
+ *
+ * read_row() and assign_row() move a run of elements of one row in one
+ * call: each line of the run is looked up once, consecutive missing lines
+ * are loaded with one read, and the elements are copied a line at a time
+ * (with one memcpy when mapped). They count as many element reads or
+ * writes as the run is long. Under LRU and CLOCK with window 1 the misses
+ * are those of the element loop; otherwise they may differ, as the engine
+ * sees one lookup per line and the window is pre-fetched once, after the
+ * run. Only row-major files have contiguous rows; other layouts fall back
+ * to element accesses.
+ *
+ * save_snapshot() writes the state of the cache to a file and
+ * load_snapshot() restores it into a buffer of the same matrix, line size
+ * and capacity, so a run can go on warm after a restart. Clean lines are
+ * read back from the matrix file without being counted. The engine must
+ * list its keys (see cache_engines.hpp): the LRUs come back exactly,
+ * CLOCK with its reference bits set. A profiler is not saved.
+ *
+ * Under WRITE_BACK, assign() only marks the cached line dirty. Dirty lines
+ * are written when evicted or on flush(), which merges adjacent dirty lines
+ * into one write.
+ *
+ * With STORAGE_MMAP the file is mapped and values are read from and stored
+ * to the mapping directly; the buffer then only models the cache, and its
+ * counters report the I/O an fstream-backed buffer would have done.
+ *
  * @tparam T Type of variables stored in the matrix.
+ * @tparam Cache Replacement engine, see cache_engines.hpp.
  */
-template <class T>
+template <class T, class Cache = lru_list_t>
 class buffer_t {
+    /* a mapped payload starts MATRIX_ARR_OFFSET bytes into the file */
+    static_assert(MATRIX_ARR_OFFSET % alignof(T) == 0,
+                  "Matrix payload misaligned for T.");
+
    private:
     struct vector_t;
-    struct cache_line;
 
    public:
     /* constructors */
-    buffer_t(char const* filename, size_t _size, size_t _window = 1) {
-        fs.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-        capacity = _size;
-        window = _window;
-        read_count = 0;
-        miss_count = 0;
+    buffer_t(char const* filename, size_t _size, size_t _window = 1,
+             size_t _line_size = 1,
+             write_policy_t _write_policy = WRITE_THROUGH,
+             storage_mode_t _storage_mode = STORAGE_FSTREAM)
+        : cache(_size) {
+        open(filename, _window, _line_size, _write_policy, _storage_mode);
+    }
 
-        /* load metadata */
-        // fs.read((char*) &magic, sizeof(uint32_t));
-        fs.seekg(sizeof(uint32_t), std::ios::beg); /* magic */
-        fs.read((char*)&row, sizeof(uint32_t));
-        fs.read((char*)&col, sizeof(uint32_t));
-        fs.read((char*)&size_of_T, sizeof(uint32_t));
+    /* for engines that need more than a capacity, e.g. opt_t */
+    buffer_t(char const* filename, Cache&& _cache, size_t _window = 1,
+             size_t _line_size = 1,
+             write_policy_t _write_policy = WRITE_THROUGH,
+             storage_mode_t _storage_mode = STORAGE_FSTREAM)
+        : cache(std::move(_cache)) {
+        open(filename, _window, _line_size, _write_policy, _storage_mode);
+    }
+
+    /* on an already opened storage, e.g. null_storage_t */
+    buffer_t(std::unique_ptr<storage_t> _file, Cache&& _cache,
+             size_t _window = 1, size_t _line_size = 1,
+             write_policy_t _write_policy = WRITE_THROUGH)
+        : cache(std::move(_cache)) {
+        file = std::move(_file);
+        init(_window, _line_size, _write_policy);
     }
 
     /* destructor */
-    ~buffer_t() { fs.close(); }
+    ~buffer_t() {
+        stop_prefetcher();
+        flush();
+    }
 
     /* operators */
     vector_t operator[](size_t i) {
@@ -86,94 +265,728 @@ class buffer_t {
 
     /* helpers */
     void assign(size_t i, size_t j, T val) {
-        auto key = i * (col) + j;
-        fs.seekp(MATRIX_ARR_OFFSET + key * sizeof(T), std::ios::beg);
-        fs.write(reinterpret_cast<char*>(&val), sizeof(T));
+        if (i >= row || j >= col) {
+            std::cerr << "Index exceeds upper bound." << std::endl;
+            return;
+        }
+        auto guard = hold();
+        auto key = key_of(i, j);
+        if (write_policy == WRITE_THROUGH) {
+            /* a mapped file is updated by LRU_set below */
+            if (!mapped)
+                file_write(MATRIX_ARR_OFFSET + key * sizeof(T), &val,
+                           sizeof(T));
+            write_op_count++;
+            bytes_written += sizeof(T);
+        }
         LRU_set(key, val);
     }
 
+    /* (i, j0), ..., (i, j0 + n - 1) = in[0], ..., in[n - 1] */
+    void assign_row(size_t i, size_t j0, size_t n, const T* in) {
+        if (i >= row || j0 + n > col) {
+            std::cerr << "Index exceeds upper bound." << std::endl;
+            return;
+        }
+        if (layout != LAYOUT_ROW_MAJOR) {
+            for (size_t j = 0; j < n; ++j) assign(i, j0 + j, in[j]);
+            return;
+        }
+        if (n == 0) return;
+        auto guard = hold();
+        size_t first = key_of(i, j0), last = first + n;
+        if (write_policy == WRITE_THROUGH) {
+            if (!mapped)
+                file_write(MATRIX_ARR_OFFSET + first * sizeof(T), in,
+                           n * sizeof(T));
+            write_op_count++;
+            bytes_written += n * sizeof(T);
+        }
+        for (size_t line = first / line_size; line * line_size < last;
+             ++line) {
+            size_t lo = std::max(first, line * line_size);
+            size_t hi = std::min(last, (line + 1) * line_size);
+            if (profiler)
+                for (size_t k = lo; k < hi; ++k) profiler->access(line, false);
+            /* a line overwritten whole needs no read */
+            auto slot = fetch_line(line, hi - lo < line_length(line));
+            if (!mapped)
+                std::copy(in + (lo - first), in + (hi - first),
+                          &value(lo, slot));
+            if (write_policy == WRITE_BACK) dirty[slot] = true;
+        }
+        if (mapped) std::memcpy(mapped + first, in, n * sizeof(T));
+    }
+
+    /* write every dirty line back, adjacent lines in a single write */
+    void flush() {
+        auto guard = hold();
+        drain(guard);
+        std::vector<std::pair<size_t, size_t>> lines;  // (line, slot)
+        for (size_t slot = 0; slot < dirty.size(); ++slot) {
+            if (dirty[slot]) lines.push_back({slot_line[slot], slot});
+        }
+        std::sort(lines.begin(), lines.end());
+
+        std::vector<T> run;
+        for (size_t k = 0; k < lines.size();) {
+            size_t first = lines[k].first, n = 0;
+            run.clear();
+            for (; k < lines.size() && lines[k].first == first + n; ++k, ++n) {
+                auto slot = lines[k].second;
+                if (!mapped)
+                    run.insert(run.end(), slots.begin() + slot * line_size,
+                               slots.begin() + (slot + 1) * line_size);
+                dirty[slot] = false;
+            }
+            write_lines(first, n, run.data());
+        }
+    }
+
     T seekg_and_read(size_t arr_offset) {
-        fs.seekg(MATRIX_ARR_OFFSET + arr_offset, std::ios::beg);
         T ret;
-        fs.read((char*)&ret, sizeof(T));
+        file_read(MATRIX_ARR_OFFSET + arr_offset, &ret, sizeof(T));
         return ret;
     }
 
-    /* LRU */
-    void LRU_set(size_t key, T value) {
-        // key not found
-        if (cache_map.find(key) == cache_map.end()) {
-            // if is full
-            if (cache_list.size() == capacity) {
-                cache_map.erase(cache_list.back().key);
-                cache_list.pop_back();
-            }
-            cache_list.push_front(cache_line(key, value));
-            cache_map[key] = cache_list.begin();
+    /* cached copy of key, or the mapped element itself */
+    T& value(size_t key, size_t slot) {
+        if (mapped) return mapped[key];
+        return slots[slot * line_size + key % line_size];
+    }
+
+    /* position of (i, j) in the file payload */
+    size_t key_of(size_t i, size_t j) const {
+        return layout_index(layout, row, col, i, j);
+    }
+
+    /* elements in line, the last line may be short */
+    size_t line_length(size_t line) {
+        return std::min(line_size, elements - line * line_size);
+    }
+
+    /* read one whole line into slot */
+    void read_line(size_t line, size_t slot) {
+        size_t n = line_length(line);
+        if (!mapped)
+            file_read(MATRIX_ARR_OFFSET + line * line_size * sizeof(T),
+                      &slots[slot * line_size], n * sizeof(T));
+        line_load_count++;
+        bytes_read += n * sizeof(T);
+    }
+
+    /* write n lines starting at line from data, the last line may be short */
+    void write_lines(size_t line, size_t n, const T* data) {
+        size_t first = line * line_size;
+        size_t count = std::min(n * line_size, elements - first);
+        if (!mapped)
+            file_write(MATRIX_ARR_OFFSET + first * sizeof(T), data,
+                       count * sizeof(T));
+        writeback_count += n;
+        write_op_count++;
+        bytes_written += count * sizeof(T);
+    }
+
+    /* give a non-resident line a slot, writing back a dirty victim */
+    size_t install_line(size_t line, bool need_data, bool demand = true) {
+        size_t victim;
+        auto slot = cache.insert(line, victim);
+        if (victim != CACHE_NPOS && dirty[slot]) {
+            write_lines(victim, 1, mapped ? nullptr : &slots[slot * line_size]);
+            dirty[slot] = false;
+        }
+        if (victim != CACHE_NPOS && prefetched[slot]) prefetch_wasted++;
+        prefetched[slot] = !demand;
+        if (!demand) prefetch_count++;
+        slot_line[slot] = line;
+        if (need_data) read_line(line, slot);
+        return slot;
+    }
+
+    /* make line resident and most recent, loading it on a miss */
+    size_t fetch_line(size_t line, bool need_data = true, bool demand = true) {
+        if (demand) await_prefetch(line);
+        auto slot = cache.find(line, demand);
+        if (slot == CACHE_NPOS) return install_line(line, need_data, demand);
+        if (demand) use_line(slot);
+        return slot;
+    }
+
+    /* a demand lookup hit slot, settle its pre-fetch if it had one */
+    void use_line(size_t slot) {
+        if (prefetched[slot]) {
+            prefetch_useful++;
+            prefetched[slot] = false;
+        }
+    }
+
+    /* learn the stride between consecutive lines read */
+    void train_stride(size_t line) {
+        if (last_line == CACHE_NPOS) return;
+        auto delta = ptrdiff_t(line - last_line);
+        if (delta == stride) {
+            stride_seen++;
         } else {
-            // update and make it the first
-            cache_map[key]->value = value;
-            cache_list.splice(cache_list.begin(), cache_list, cache_map[key]);
-            cache_map[key] = cache_list.begin();
+            stride = delta;
+            stride_seen = 1;
+        }
+    }
+
+    /* LRU */
+    void LRU_set(size_t key, T val) {
+        /* a single-element line is overwritten whole, no need to read it */
+        if (profiler) profiler->access(key / line_size, false);
+        auto slot = fetch_line(key / line_size, line_size > 1);
+        value(key, slot) = val;
+        if (write_policy == WRITE_BACK) dirty[slot] = true;
+    }
+
+    /* counted and timed element read */
+    T read(size_t i, size_t j) {
+        if (i >= row || j >= col) {
+            std::cerr << "Index exceeds upper bound." << std::endl;
+            return T();
         }
+        auto start = std::chrono::steady_clock::now();
+        auto guard = hold();
+        read_count++;
+        auto ret = LRU_get(i, j);
+        read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+        return ret;
+    }
+
+    /* out[0], ..., out[n - 1] = (i, j0), ..., (i, j0 + n - 1), counted and
+       timed as n reads */
+    void read_row(size_t i, size_t j0, size_t n, T* out) {
+        if (i >= row || j0 + n > col) {
+            std::cerr << "Index exceeds upper bound." << std::endl;
+            return;
+        }
+        if (layout != LAYOUT_ROW_MAJOR) {
+            for (size_t j = 0; j < n; ++j) out[j] = read(i, j0 + j);
+            return;
+        }
+        if (n == 0) return;
+        auto start = std::chrono::steady_clock::now();
+        auto guard = hold();
+        read_count += n;
+        LRU_get_span(key_of(i, j0), n, out);
+        read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
     }
 
     T LRU_get(size_t i, size_t j) {
-        auto key = i * (col) + j;
-        if (cache_map.find(key) == cache_map.end()) {  // cache miss!
+        auto key = key_of(i, j);
+        auto line = key / line_size;
+        if (line != last_line) {
+            line_read_count++;
+            train_stride(line);
+            last_line = line;
+        }
+        if (profiler) profiler->access(line);
+        await_prefetch(line);
+        auto slot = cache.find(line);
+        if (slot != CACHE_NPOS) {
+            use_line(slot);
+            return value(key, slot);
+        }
+
+        // cache miss!
+        miss_count++;
+        line_miss_count++;
+        slot = install_line(line, true);
+        auto ret = value(key, slot);
+        prefetch_after(line);
+        return ret;
+    }
+
+    /* the n elements from key first into out, see read_row() */
+    void LRU_get_span(size_t first, size_t n, T* out) {
+        size_t last = first + n;
+        size_t end_line = (last - 1) / line_size + 1;
+        bool missed = false;
+        std::vector<std::pair<size_t, size_t>> pending;  // (line, slot)
+        for (size_t line = first / line_size; line < end_line; ++line) {
+            span_lookup(line, first, last);
+            auto slot = cache.find(line);
+            if (slot != CACHE_NPOS) {
+                use_line(slot);
+                span_copy(line, slot, first, last, out);
+                span_load(pending, first, last, out);
+                continue;
+            }
+
+            // cache miss! the slot is taken now, the data comes with the
+            // next lines that miss
             miss_count++;
-            auto ret = seekg_and_read(key * sizeof(T));
-            LRU_set(key, ret);
-            for (auto k = 2; k <= window; ++k) {  // pre-fetch
-                key++;
-                if (key >= row * col) break;
-                auto v = seekg_and_read(key * sizeof(T));
-                LRU_set(key, v);
+            line_miss_count++;
+            pending.push_back({line, install_line(line, false)});
+            missed = true;
+        }
+        span_load(pending, first, last, out);
+        if (mapped) std::memcpy(out, mapped + first, n * sizeof(T));
+        if (missed) prefetch_after(end_line - 1);
+    }
+
+    /**
+     * @brief Loads consecutive pending lines with one read into their slots
+     *        and their part of [first, last) into out. A slot taken over by
+     *        a later line of the run keeps that line.
+     */
+    void span_load(std::vector<std::pair<size_t, size_t>>& pending,
+                   size_t first, size_t last, T* out) {
+        if (pending.empty()) return;
+        size_t line = pending[0].first;
+        size_t count =
+            std::min(pending.size() * line_size, elements - line * line_size);
+        line_load_count += pending.size();
+        bytes_read += count * sizeof(T);
+        if (!mapped) {
+            span_staging.resize(count);
+            file_read(MATRIX_ARR_OFFSET + line * line_size * sizeof(T),
+                      span_staging.data(), count * sizeof(T));
+            for (auto& p : pending) {
+                auto src = span_staging.begin() + (p.first - line) * line_size;
+                size_t lo = std::max(first, p.first * line_size);
+                size_t hi = std::min(last, (p.first + 1) * line_size);
+                std::copy(src + lo % line_size, src + lo % line_size + hi - lo,
+                          out + (lo - first));
+                if (slot_line[p.second] == p.first)
+                    std::copy(src, src + line_length(p.first),
+                              slots.begin() + p.second * line_size);
             }
-            return ret;
-        } else {
-            cache_list.splice(cache_list.begin(), cache_list, cache_map[key]);
-            cache_map[key] = cache_list.begin();
-            return cache_map[key]->value;
         }
+        pending.clear();
+    }
+
+    /* bookkeeping of an element loop over the part of [first, last) in
+       line, short of the cache lookup itself */
+    void span_lookup(size_t line, size_t first, size_t last) {
+        if (line != last_line) {
+            line_read_count++;
+            train_stride(line);
+            last_line = line;
+        }
+        if (profiler) {
+            size_t lo = std::max(first, line * line_size);
+            size_t hi = std::min(last, (line + 1) * line_size);
+            for (size_t k = lo; k < hi; ++k) profiler->access(line);
+        }
+        await_prefetch(line);
+    }
+
+    /* copy the part of [first, last) in line out of slot */
+    void span_copy(size_t line, size_t slot, size_t first, size_t last,
+                   T* out) {
+        if (mapped) return;  // copied in one go at the end
+        size_t lo = std::max(first, line * line_size);
+        size_t hi = std::min(last, (line + 1) * line_size);
+        std::copy(&value(lo, slot), &value(lo, slot) + (hi - lo),
+                  out + (lo - first));
+    }
+
+    /* pre-fetch the window after a demand miss of line */
+    void prefetch_after(size_t line) {
+        ptrdiff_t step = 1;
+        if (prefetch_policy == PREFETCH_STRIDE && stride_seen >= 2)
+            step = stride;
+        for (size_t k = 2; k <= window; ++k) {  // pre-fetch
+            line += step;
+            if (line >= line_count) break;  // negative steps wrap around
+            if (prefetching)
+                queue_prefetch(line);
+            else
+                fetch_line(line, true, false);
+        }
+        if (prefetching) {
+            /* the prefetcher lags behind, drop the stalest requests */
+            while (prefetch_queue.size() > capacity)
+                prefetch_queue.pop_front();
+            prefetch_cv.notify_all();
+        }
+    }
+
+    /**
+     * @brief Writes the resident lines with their dirty and pre-fetched
+     *        bits, the data of dirty lines, the counters and the stride
+     *        state to filename.
+     * @return false if filename could not be written.
+     */
+    bool save_snapshot(const char* filename) {
+        auto guard = hold();
+        drain(guard);
+        std::fstream fs(filename, std::ios::out | std::ios::binary);
+        if (!fs) {
+            std::cerr << "Error opening file: " << filename << "\n";
+            return false;
+        }
+        auto lines = cache.keys();
+        snapshot_header_t header = {};
+        header.magic = SNAPSHOT_MAGIC;
+        header.row = row;
+        header.col = col;
+        header.layout = layout;
+        header.line_size = line_size;
+        header.capacity = capacity;
+        header.count = lines.size();
+        auto values = counters();
+        for (size_t n = 0; n < SNAPSHOT_COUNTERS; ++n)
+            header.counters[n] = *values[n];
+        header.stride = stride;
+        header.stride_seen = stride_seen;
+        header.last_line = last_line;
+        fs.write(reinterpret_cast<char*>(&header), sizeof(header));
+
+        std::unordered_map<size_t, size_t> slot_of;  // line -> slot
+        for (size_t slot = 0; slot < capacity; ++slot)
+            if (slot_line[slot] != CACHE_NPOS) slot_of[slot_line[slot]] = slot;
+        for (auto line : lines) {
+            auto slot = slot_of[line];
+            uint64_t record = uint64_t(line) << 2 | dirty[slot] << 1 |
+                              prefetched[slot];
+            fs.write(reinterpret_cast<char*>(&record), sizeof(record));
+            if (dirty[slot] && !mapped)
+                fs.write(reinterpret_cast<char*>(&slots[slot * line_size]),
+                         line_length(line) * sizeof(T));
+        }
+        return fs.good();
+    }
+
+    /**
+     * @brief Replaces the cache state with that saved in filename, after
+     *        writing back the current dirty lines. The records and the
+     *        dirty data are read and checked before the cache is touched.
+     * @return false, leaving the buffer as it was, if filename is not a
+     *         whole snapshot of a buffer like this one.
+     */
+    bool load_snapshot(const char* filename) {
+        std::fstream fs(filename, std::ios::in | std::ios::binary);
+        snapshot_header_t header = {};
+        fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!fs || header.magic != SNAPSHOT_MAGIC) {
+            std::cerr << "Not a snapshot file: " << filename << "\n";
+            return false;
+        }
+        if (header.row != row || header.col != col ||
+            header.layout != layout || header.line_size != line_size ||
+            header.capacity != capacity || header.count > capacity) {
+            std::cerr << "Snapshot " << filename
+                      << " is of another matrix or cache geometry.\n";
+            return false;
+        }
+
+        /* records, and the dirty lines' data one after another */
+        std::vector<uint64_t> records(header.count);
+        std::vector<T> dirty_data;
+        std::unordered_set<size_t> seen;
+        for (auto& record : records) {
+            fs.read(reinterpret_cast<char*>(&record), sizeof(record));
+            if (!fs) break;
+            size_t line = record >> 2;
+            if (line >= line_count || !seen.insert(line).second) {
+                std::cerr << "Snapshot " << filename
+                          << " holds a line out of range or twice.\n";
+                return false;
+            }
+            if (!(record & 2) || mapped) continue;
+            size_t at = dirty_data.size();
+            dirty_data.resize(at + line_length(line));
+            fs.read(reinterpret_cast<char*>(&dirty_data[at]),
+                    line_length(line) * sizeof(T));
+            if (!fs) break;
+        }
+        if (!fs) {
+            std::cerr << "Snapshot " << filename << " is truncated.\n";
+            return false;
+        }
+        flush();
+
+        auto guard = hold();
+        cache.clear();
+        slot_line.assign(capacity, CACHE_NPOS);
+        dirty.assign(capacity, false);
+        prefetched.assign(capacity, false);
+        size_t at = 0;
+        for (auto record : records) {
+            size_t line = record >> 2, victim;
+            auto slot = cache.insert(line, victim);
+            slot_line[slot] = line;
+            dirty[slot] = record & 2;
+            prefetched[slot] = record & 1;
+            if (mapped) continue;
+            auto data = &slots[slot * line_size];
+            if (dirty[slot]) {
+                std::copy_n(&dirty_data[at], line_length(line), data);
+                at += line_length(line);
+            } else {
+                file_read(MATRIX_ARR_OFFSET + line * line_size * sizeof(T),
+                          data, line_length(line) * sizeof(T));
+            }
+        }
+
+        auto values = counters();
+        for (size_t n = 0; n < SNAPSHOT_COUNTERS; ++n)
+            *values[n] = header.counters[n];
+        stride = header.stride;
+        stride_seen = header.stride_seen;
+        last_line = header.last_line;
+        return true;
+    }
+
+    /* move the window pre-fetch to a background thread */
+    void start_prefetcher() {
+        if (prefetching) return;
+        prefetching = true;
+        prefetcher = std::thread([this]() { prefetch_loop(); });
+    }
+
+    /* finish the queued pre-fetches and go back to synchronous */
+    void stop_prefetcher() {
+        if (!prefetching) return;
+        {
+            std::unique_lock<std::mutex> guard(state_mutex);
+            drain(guard);
+            prefetching = false;
+        }
+        prefetch_cv.notify_all();
+        prefetcher.join();
     }
 
     /* buffer params */
-    size_t capacity;
-    size_t window;
+    size_t capacity;   // in lines
+    size_t window;     // in lines
+    size_t line_size;  // elements per line
+    write_policy_t write_policy;
+    prefetch_policy_t prefetch_policy = PREFETCH_SEQUENTIAL;
 
     /* persistent */
     uint32_t row;
     uint32_t col;
     uint32_t size_of_T;
+    uint32_t layout;
+    size_t elements;  // in the file payload, padding included
+    size_t line_count;
 
     /* volatile */
-    std::list<cache_line> cache_list;
-    std::unordered_map<size_t, typename std::list<cache_line>::iterator>
-        cache_map;
+    Cache cache;
+    std::vector<T> slots;  // cached lines by slot, empty if mapped
+    std::vector<size_t> slot_line;  // line held by each slot
+    std::vector<bool> dirty;        // per slot, WRITE_BACK only
+    std::vector<bool> prefetched;   // per slot, loaded ahead and not yet used
+    std::vector<T> span_staging;    // lines read together by read_row()
+    ptrdiff_t stride = 0;           // last delta between lines read
+    size_t stride_seen = 0;         // times in a row stride was seen
 
     /* stat */
-    uint32_t miss_count;
-    uint32_t read_count;
+    uint64_t miss_count;       // element reads that missed
+    uint64_t read_count;       // element reads
+    uint64_t line_miss_count;  // demand line loads
+    uint64_t line_read_count;  // reads that moved on to another line
+    uint64_t line_load_count;  // line loads, pre-fetch included
+    uint64_t bytes_read;
+    uint64_t writeback_count;  // dirty lines written back
+    uint64_t write_op_count;   // write calls issued to the file
+    uint64_t bytes_written;
+    uint64_t prefetch_count;   // lines loaded ahead of demand
+    uint64_t prefetch_useful;  // ... later hit by a demand lookup
+    uint64_t prefetch_wasted;  // ... evicted without being used
+    uint64_t read_ns;          // wall-clock time spent in read()
+    size_t last_line;
+    reuse_distance_t* profiler = nullptr;  // optional, sees demand lookups
     inline float miss_rate() { return 1.0f * miss_count / read_count; }
-    inline void reset_counters() { miss_count = read_count = 0; }
+    inline float line_miss_rate() {
+        return 1.0f * line_miss_count / line_read_count;
+    }
+    inline float read_latency() { return 1.0f * read_ns / read_count; }
+    inline float prefetch_accuracy() {
+        auto settled = prefetch_useful + prefetch_wasted;
+        return settled ? 1.0f * prefetch_useful / settled : 0.0f;
+    }
+    inline void reset_counters() {
+        auto guard = hold();
+        miss_count = read_count = 0;
+        read_ns = 0;
+        line_miss_count = line_read_count = line_load_count = 0;
+        bytes_read = 0;
+        writeback_count = write_op_count = 0;
+        bytes_written = 0;
+        prefetch_count = prefetch_useful = prefetch_wasted = 0;
+        prefetched.assign(prefetched.size(), false);
+        last_line = CACHE_NPOS;
+        if (profiler) profiler->clear();
+    }
 
    private:
-    std::fstream fs;
+    std::unique_ptr<storage_t> file;
+    T* mapped = nullptr;  // matrix payload when the file is memory-mapped
+
+    /* background pre-fetch */
+    bool prefetching = false;  // the prefetcher thread is running
+    std::thread prefetcher;
+    std::mutex state_mutex;  // everything above but file, while prefetching
+    std::mutex io_mutex;     // file, while prefetching
+    std::condition_variable prefetch_cv;
+    std::deque<size_t> prefetch_queue;  // lines waiting to be pre-fetched
+    size_t inflight = CACHE_NPOS;       // line the prefetcher is reading
+
+    /* the counters in snapshot order */
+    std::vector<uint64_t*> counters() {
+        return {&miss_count,      &read_count,      &line_miss_count,
+                &line_read_count, &line_load_count, &bytes_read,
+                &writeback_count, &write_op_count,  &bytes_written,
+                &prefetch_count,  &prefetch_useful, &prefetch_wasted,
+                &read_ns};
+    }
 
-    /* structures */
-    struct cache_line {
-        uint32_t key;
-        T value;
-        cache_line(uint32_t k, T v) : key(k), value(v) {}
-    };
+    /* state_mutex, held only when there is another thread to exclude */
+    std::unique_lock<std::mutex> hold() {
+        if (!prefetching) return std::unique_lock<std::mutex>();
+        return std::unique_lock<std::mutex>(state_mutex);
+    }
+
+    /* a failed storage stays failed, so only the first failure is told */
+    void file_read(size_t offset, void* dst, size_t bytes) {
+        std::unique_lock<std::mutex> guard;
+        if (prefetching) guard = std::unique_lock<std::mutex>(io_mutex);
+        bool was_good = file->good();
+        file->read(offset, dst, bytes);
+        if (was_good && !file->good())
+            std::cerr << "Error reading the matrix file.\n";
+    }
+
+    void file_write(size_t offset, const void* src, size_t bytes) {
+        std::unique_lock<std::mutex> guard;
+        if (prefetching) guard = std::unique_lock<std::mutex>(io_mutex);
+        bool was_good = file->good();
+        file->write(offset, src, bytes);
+        if (was_good && !file->good())
+            std::cerr << "Error writing the matrix file.\n";
+    }
+
+    /* wait until the prefetcher has emptied its queue */
+    void drain(std::unique_lock<std::mutex>& guard) {
+        if (!guard) return;
+        prefetch_cv.wait(guard, [this]() {
+            return prefetch_queue.empty() && inflight == CACHE_NPOS;
+        });
+    }
+
+    void queue_prefetch(size_t line) {
+        if (line == inflight) return;
+        auto& q = prefetch_queue;
+        if (std::find(q.begin(), q.end(), line) == q.end()) q.push_back(line);
+    }
+
+    /**
+     * @brief Called with state_mutex held before a demand lookup of line:
+     *        waits for line if it is in flight, or takes it over from the
+     *        queue so the caller loads it now.
+     */
+    void await_prefetch(size_t line) {
+        if (!prefetching) return;
+        auto& q = prefetch_queue;
+        q.erase(std::remove(q.begin(), q.end(), line), q.end());
+        if (line != inflight) return;
+        std::unique_lock<std::mutex> guard(state_mutex, std::adopt_lock);
+        prefetch_cv.wait(guard, [&]() { return inflight != line; });
+        guard.release();  // still held by the caller
+    }
+
+    void prefetch_loop() {
+        std::vector<T> staging(line_size);
+        std::unique_lock<std::mutex> guard(state_mutex);
+        while (true) {
+            prefetch_cv.wait(guard, [this]() {
+                return !prefetch_queue.empty() || !prefetching;
+            });
+            if (prefetch_queue.empty()) return;  // stopped and drained
+            auto line = prefetch_queue.front();
+            prefetch_queue.pop_front();
+            if (cache.find(line, false) != CACHE_NPOS) {
+                prefetch_cv.notify_all();  // may have emptied the queue
+                continue;
+            }
+
+            /* read without state_mutex, then install */
+            size_t n = line_length(line);
+            inflight = line;
+            guard.unlock();
+            if (!mapped)
+                file_read(MATRIX_ARR_OFFSET + line * line_size * sizeof(T),
+                          staging.data(), n * sizeof(T));
+            guard.lock();
+            auto slot = install_line(line, false, false);
+            if (!mapped)
+                std::copy(staging.begin(), staging.begin() + n,
+                          slots.begin() + slot * line_size);
+            line_load_count++;
+            bytes_read += n * sizeof(T);
+            inflight = CACHE_NPOS;
+            prefetch_cv.notify_all();
+        }
+    }
+
+    void open(char const* filename, size_t _window, size_t _line_size,
+              write_policy_t _write_policy, storage_mode_t _storage_mode) {
+        /* a read-only file still serves a buffer that is only read; a write
+         * then fails the storage instead of the open */
+        bool writable = ::access(filename, W_OK) == 0;
+        file = open_storage(filename, _storage_mode, writable);
+        init(_window, _line_size, _write_policy);
+    }
+
+    void init(size_t _window, size_t _line_size,
+              write_policy_t _write_policy) {
+        capacity = cache.capacity();
+        window = _window;
+        line_size = _line_size;
+        write_policy = _write_policy;
+        slot_line.assign(capacity, CACHE_NPOS);
+        dirty.assign(capacity, false);
+        prefetched.assign(capacity, false);
+        reset_counters();
+
+        /* a file that failed to open, or is shorter than its header says,
+         * is an empty matrix, every index out of bounds */
+        auto leave_empty = [&](const char* why) {
+            std::cerr << why << ", buffer left empty." << std::endl;
+            row = col = size_of_T = layout = 0;
+            elements = line_count = 0;
+        };
+        if (!file->good()) return leave_empty("No matrix file");
+
+        /* load metadata */
+        matrix_t<T> header = {};
+        file->read(0, &header, MATRIX_ARR_OFFSET);
+        if (!file->good() || !header.header_ok())
+            return leave_empty("Not a matrix file of this format");
+        row = header.row;
+        col = header.col;
+        size_of_T = header.size_of_T;
+        layout = header.layout;
+        elements = layout_elements(layout, row, col);
+        size_t bytes = file->size();
+        if (bytes < MATRIX_ARR_OFFSET ||
+            elements > (bytes - MATRIX_ARR_OFFSET) / sizeof(T))
+            return leave_empty("Matrix file shorter than its header");
+        line_count = (elements + line_size - 1) / line_size;
+
+        /* writes go through the mapping, so only a writable one is used */
+        if (file->data() && file->writable())
+            mapped = reinterpret_cast<T*>(file->data() + MATRIX_ARR_OFFSET);
+        else
+            slots.assign(capacity * line_size, T());
+    }
 
     /* proxy class */
     struct vector_t {
         size_t i;
-        buffer_t<T>* parent;
+        buffer_t<T, Cache>* parent;
         /* constructors */
-        vector_t(size_t _i, buffer_t<T>* e) : i(_i), parent(e) {}
+        vector_t(size_t _i, buffer_t<T, Cache>* e) : i(_i), parent(e) {}
 
         /* operators */
 
@@ -185,11 +998,18 @@ class buffer_t {
                 std::cerr << "Index exceeds upper bound." << std::endl;
                 ret = parent->seekg_and_read(i * (parent->col) * sizeof(T));
             } else {
-                parent->read_count++;
-                ret = parent->LRU_get(i, j);
+                ret = parent->read(i, j);
             }
             return ret;
         }
+
+        /* n elements from column j0, see read_row() */
+        void read(size_t j0, size_t n, T* out) const {
+            parent->read_row(i, j0, n, out);
+        }
+        void assign(size_t j0, size_t n, const T* in) const {
+            parent->assign_row(i, j0, n, in);
+        }
     };
 };
 
@@ -250,7 +1070,8 @@ class TreeNode {
     T data;
 };
 
-template <class T>
+/* the middle group is a MinMaxHeap<T> or an interval_heap_t<T> */
+template <class T, class Heap = MinMaxHeap<T>>
 class ext_qsort_t {
    public:
     ext_qsort_t(unsigned int ninput, unsigned int nsmall, unsigned int nlarge,
@@ -268,7 +1089,80 @@ class ext_qsort_t {
     std::vector<T> input_buffer;
     std::vector<T> small_group;
     std::vector<T> large_group;
-    MinMaxHeap<T> middle_group;
+    Heap middle_group;
+};
+
+/* popMin() then push(x), fused where the heap can */
+template <class Heap, class T>
+T replace_min(Heap& heap, const T& x) {
+    T top = heap.popMin();
+    heap.push(x);
+    return top;
+}
+template <class T>
+T replace_min(interval_heap_t<T>& heap, const T& x) {
+    return heap.replaceMin(x);
+}
+
+/* popMax() then push(x), fused where the heap can */
+template <class Heap, class T>
+T replace_max(Heap& heap, const T& x) {
+    T top = heap.popMax();
+    heap.push(x);
+    return top;
+}
+template <class T>
+T replace_max(interval_heap_t<T>& heap, const T& x) {
+    return heap.replaceMax(x);
+}
+
+/**
+ * @brief Maps a key to one of k = 2^levels buckets by k - 1 sorted
+ *        splitters: bucket j holds the keys in (s[j - 1], s[j]].
+ *
+ * The splitters are stored as an implicit search tree in Eytzinger order,
+ * tree[1] the root and tree[2i], tree[2i + 1] the children of tree[i], so a
+ * lookup is levels steps of i = 2i + (x > tree[i]) with no branch to
+ * mispredict, and the top levels stay in L1 for every key.
+ */
+template <class T>
+class splitter_tree_t {
+   public:
+    /* splitters: 2^levels - 1 keys in ascending order */
+    explicit splitter_tree_t(const std::vector<T>& splitters)
+        : tree(splitters.size() + 1), nways(splitters.size() + 1) {
+        levels = 0;
+        while ((size_t(1) << levels) < nways) ++levels;
+        size_t next = 0;
+        build(splitters, next, 1);
+    }
+
+    size_t ways() const { return nways; }
+
+    size_t bucket_of(const T& x) const {
+        size_t i = 1;
+        for (size_t l = 0; l < levels; ++l) i = 2 * i + (x > tree[i]);
+        return i - nways;
+    }
+
+    /* bucket_of() for n keys at once, the loads of one key overlapping the
+     * next */
+    void classify(const T* in, size_t n, uint16_t* out) const {
+        for (size_t e = 0; e < n; ++e) out[e] = bucket_of(in[e]);
+    }
+
+   private:
+    /* in-order walk of the implicit tree hands out the sorted splitters */
+    void build(const std::vector<T>& splitters, size_t& next, size_t i) {
+        if (i >= nways) return;
+        build(splitters, next, 2 * i);
+        tree[i] = splitters[next++];
+        build(splitters, next, 2 * i + 1);
+    }
+
+    std::vector<T> tree;  // tree[0] unused
+    size_t nways;
+    size_t levels;
 };
 
 /* Phase 3 */
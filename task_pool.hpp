@@ -0,0 +1,166 @@
+/**
+ * @file task_pool.hpp
+ * @author HUANG Qiyue
+ * @brief Work-stealing task pool and a shared memory budget.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * Every worker owns a deque of tasks. A task may push more tasks, which go
+ * to the back of its worker's deque; the worker takes its next task from
+ * the back too, so it goes on depth first, while an idle worker steals
+ * from the front of another deque, taking the oldest and usually largest
+ * piece of work. run() returns once every task, including those pushed by
+ * tasks, has finished.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Bytes of memory shared by concurrent tasks: a task acquires its
+ *        slice before it starts and releases it when done, so the slices
+ *        in use never add up to more than the total.
+ */
+class memory_budget_t {
+   public:
+    explicit memory_budget_t(size_t _total)
+        : total(_total), available(_total) {}
+
+    /* waits until least bytes are free, then takes up to most of them */
+    size_t acquire(size_t least, size_t most) {
+        least = std::min(least, total);
+        std::unique_lock<std::mutex> guard(lock);
+        cv.wait(guard, [&]() { return available >= least; });
+        size_t got = std::min(std::max(least, most), available);
+        available -= got;
+        in_use_peak = std::max(in_use_peak, total - available);
+        return got;
+    }
+
+    void release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            available += bytes;
+        }
+        cv.notify_all();
+    }
+
+    const size_t total;
+    size_t in_use_peak = 0;  // most bytes acquired at once
+
+   private:
+    size_t available;
+    std::mutex lock;
+    std::condition_variable cv;
+};
+
+/**
+ * @brief Workers with one deque of tasks each, see the file comment.
+ */
+class task_pool_t {
+   public:
+    /* a task runs on worker and may push() more tasks */
+    using task_t = std::function<void(task_pool_t& pool, size_t worker)>;
+
+    explicit task_pool_t(size_t nworkers) {
+        nworkers = std::max<size_t>(nworkers, 1);
+        for (size_t w = 0; w < nworkers; ++w) deques.emplace_back(new deque_t);
+    }
+
+    size_t size() const { return deques.size(); }
+
+    /* queue task on worker's deque; before run(), any worker will do */
+    void push(task_t task, size_t worker = 0) {
+        outstanding++;
+        {
+            auto& d = *deques[worker % deques.size()];
+            std::lock_guard<std::mutex> guard(d.lock);
+            d.tasks.push_back(std::move(task));
+            queued++;  // under the lock pop() and steal() decrement it in
+        }
+        wake();
+    }
+
+    /* runs the queued tasks and everything they push, then returns */
+    void run() {
+        std::vector<std::thread> workers;
+        for (size_t w = 0; w < deques.size(); ++w)
+            workers.emplace_back([this, w]() { work(w); });
+        for (auto& worker : workers) worker.join();
+    }
+
+    /* stat */
+    std::atomic<uint64_t> steal_count{0};
+
+   private:
+    struct deque_t {
+        std::mutex lock;
+        std::deque<task_t> tasks;
+    };
+
+    void work(size_t w) {
+        while (true) {
+            task_t task;
+            if (pop(w, task) || steal(w, task)) {
+                task(*this, w);
+                if (--outstanding == 0) wake();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_lock);
+            idle_cv.wait(guard,
+                         [this]() { return queued > 0 || outstanding == 0; });
+            if (outstanding == 0) return;
+        }
+    }
+
+    bool pop(size_t w, task_t& task) {
+        auto& d = *deques[w];
+        std::lock_guard<std::mutex> guard(d.lock);
+        if (d.tasks.empty()) return false;
+        task = std::move(d.tasks.back());
+        d.tasks.pop_back();
+        queued--;
+        return true;
+    }
+
+    bool steal(size_t w, task_t& task) {
+        for (size_t n = 1; n < deques.size(); ++n) {
+            auto& d = *deques[(w + n) % deques.size()];
+            std::lock_guard<std::mutex> guard(d.lock);
+            if (d.tasks.empty()) continue;
+            task = std::move(d.tasks.front());
+            d.tasks.pop_front();
+            queued--;
+            steal_count++;
+            return true;
+        }
+        return false;
+    }
+
+    /* the lock orders the counter change before an idle worker's check */
+    void wake() {
+        { std::lock_guard<std::mutex> guard(idle_lock); }
+        idle_cv.notify_all();
+    }
+
+    std::vector<std::unique_ptr<deque_t>> deques;
+    std::atomic<size_t> outstanding{0};  // pushed and not yet finished
+    std::atomic<size_t> queued{0};       // waiting in a deque
+    std::mutex idle_lock;
+    std::condition_variable idle_cv;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file transpose.hpp
+ * @author HUANG Qiyue
+ * @brief Out-of-core transpose of matrix files.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * transpose_file() writes a copy of a row-major matrix file whose payload
+ * is the transpose and whose header carries LAYOUT_TRANSPOSED. The copy is
+ * the same matrix to buffer_t, load_matrix and ooc_gemm, but its columns
+ * are contiguous, so a walk down a column of b reads the file in order.
+ * Transposing a transposed file gives back the row-major one.
+ *
+ * The payload moves in square tiles: a tile is read with one read per row,
+ * transposed in memory, and written with one write per row of the output,
+ * so every I/O call moves a whole tile row. Two tiles are resident at a
+ * time and the tile is as large as the memory budget allows.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "defs.h"
+#include "storage.hpp"
+#include "structures.hpp"
+
+struct transpose_stat_t {
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t read_ops = 0;
+    uint64_t write_ops = 0;
+    size_t tile = 0;  // side of the tiles used
+};
+
+/**
+ * @brief dst[c * dst_stride + r] = src[r * src_stride + c] for the h x w
+ *        block at src, in 16 x 16 pieces so both sides stay in cache.
+ */
+template <class E>
+void transpose_block(const E* src, size_t src_stride, E* dst,
+                     size_t dst_stride, size_t h, size_t w) {
+    const size_t B = 16;
+    for (size_t r0 = 0; r0 < h; r0 += B)
+        for (size_t c0 = 0; c0 < w; c0 += B)
+            for (size_t r = r0; r < std::min(r0 + B, h); ++r)
+                for (size_t c = c0; c < std::min(c0 + B, w); ++c)
+                    dst[c * dst_stride + r] = src[r * src_stride + c];
+}
+
+/**
+ * @brief Writes the transpose of the R x C payload of in, E-sized elements,
+ *        into out as C x R, one T x T tile at a time. Output rows are
+ *        finished band by band, so out is written front to back.
+ */
+template <class E>
+void transpose_payload(storage_t& in, storage_t& out, size_t R, size_t C,
+                       size_t T, transpose_stat_t& stat) {
+    std::vector<E> src(T * T), dst(T * T);
+    for (size_t c0 = 0; c0 < C; c0 += T) {
+        size_t w = std::min(T, C - c0);
+        for (size_t r0 = 0; r0 < R; r0 += T) {
+            size_t h = std::min(T, R - r0);
+            for (size_t r = 0; r < h; ++r) {
+                in.read(MATRIX_ARR_OFFSET + ((r0 + r) * C + c0) * sizeof(E),
+                        &src[r * w], w * sizeof(E));
+            }
+            transpose_block(src.data(), w, dst.data(), h, h, w);
+            for (size_t c = 0; c < w; ++c) {
+                out.write(MATRIX_ARR_OFFSET + ((c0 + c) * R + r0) * sizeof(E),
+                          &dst[c * h], h * sizeof(E));
+            }
+            stat.bytes_read += h * w * sizeof(E);
+            stat.bytes_written += h * w * sizeof(E);
+            stat.read_ops += h;
+            stat.write_ops += w;
+        }
+    }
+}
+
+/**
+ * @brief Writes a transposed copy of the matrix file in_name to out_name
+ *        with at most mem bytes of tiles in memory.
+ * @return false if in_name is not a row-major matrix file.
+ */
+inline bool transpose_file(const char* in_name, const char* out_name,
+                           size_t mem, transpose_stat_t& stat) {
+    auto in = open_storage(in_name, STORAGE_FSTREAM, false);
+    uint32_t header[MATRIX_METADATA] = {0};
+    if (!in->good()) {
+        std::cerr << "Error opening file: " << in_name << "\n";
+        return false;
+    }
+    in->read(0, header, MATRIX_ARR_OFFSET);
+    uint32_t row = header[1], col = header[2], size_of_T = header[3];
+    uint32_t& layout = header[4];
+    if (header[0] != MAGIC || header[5] != MATRIX_ARR_OFFSET ||
+        (layout & ~LAYOUT_TRANSPOSED) != 0) {
+        std::cerr << in_name << " is not a row-major matrix file.\n";
+        return false;
+    }
+    if (in->size() < MATRIX_ARR_OFFSET + size_t(row) * col * size_of_T) {
+        std::cerr << in_name << " is shorter than its header says.\n";
+        return false;
+    }
+
+    /* the payload as stored, rows of the file by columns */
+    bool transposed = layout & LAYOUT_TRANSPOSED;
+    size_t R = transposed ? col : row;
+    size_t C = transposed ? row : col;
+    layout ^= LAYOUT_TRANSPOSED;
+    {
+        std::fstream fs(out_name, std::ios::out | std::ios::binary);
+        fs.write(reinterpret_cast<char*>(header), MATRIX_ARR_OFFSET);
+    }
+    auto out = open_storage(out_name, STORAGE_FSTREAM);
+
+    size_t T = std::sqrt(mem / (2.0 * std::max<uint32_t>(size_of_T, 1)));
+    T = std::max<size_t>(std::min(T, std::max(R, C)), 1);
+    stat.tile = T;
+    switch (size_of_T) {
+        case 1: transpose_payload<uint8_t>(*in, *out, R, C, T, stat); break;
+        case 2: transpose_payload<uint16_t>(*in, *out, R, C, T, stat); break;
+        case 4: transpose_payload<uint32_t>(*in, *out, R, C, T, stat); break;
+        case 8: transpose_payload<uint64_t>(*in, *out, R, C, T, stat); break;
+        default:
+            std::cerr << "Unsupported element size " << size_of_T << "\n";
+            return false;
+    }
+    if (!in->good() || !out->good()) {
+        std::cerr << "I/O error, " << out_name << " is incomplete.\n";
+        return false;
+    }
+    return true;
+}
+
+#endif